@@ -1,8 +1,15 @@
 #include "DiscordESP.hpp"
-#include <StreamUtils.hpp>
 #include "DiscordMessageFlags.h"
+#include "RequestBody.hpp"
+#include "DiscordMessageTemplate.hpp"
+#include "ResponseBodyStream.hpp"
 
 #define BASE_DISCORD_API_URL "https://discord.com/api/v10/"
+#if defined(ESP8266)
+#define DISCORD_ESP_USER_AGENT "DiscordBot (https://github.com/ElectroHeavenVN/IoT_Libraries/tree/main/DiscordESP, 1.0), ESP8266HTTPClient"
+#elif defined(ESP32)
+#define DISCORD_ESP_USER_AGENT "DiscordBot (https://github.com/ElectroHeavenVN/IoT_Libraries/tree/main/DiscordESP, 1.0), ESP32HTTPClient"
+#endif
 
 static const char DISCORD_COM_CA[] PROGMEM = R"(
 -----BEGIN CERTIFICATE-----
@@ -19,11 +26,62 @@ BBSATNbrdP9JNqPV2Py1PsVq8JQdjDAKBggqhkjOPQQDAwNpADBmAjEA6ED/g94D
 p/SgguMh1YQdc4acLa/KNJvxn7kjNuK8YAOdgLOaVsjh4rsUecrNIdSUtUlD
 -----END CERTIFICATE-----)";
 
-WiFiClientSecure DiscordESP::_wifiClient;
-HTTPClient DiscordESP::_httpClient;
-std::optional<DeserializationOption::Filter> DiscordESP::_currentFilter = std::nullopt;
+namespace
+{
+    // Collects small writes into chunks of DISCORD_ESP_SEND_CHUNK_SIZE bytes, so a request goes out
+    // in a few TLS records, and remembers whether any of them failed
+    class BufferedClientWriter : public Print
+    {
+    public:
+        BufferedClientWriter(Client &client) : _client(client) {}
+
+        size_t write(uint8_t c) override { return write(&c, 1); }
+
+        size_t write(const uint8_t *data, size_t length) override
+        {
+            for (size_t written = 0; written < length;)
+            {
+                if (_length == sizeof(_buffer))
+                    _flushBuffer();
+                size_t count = length - written < sizeof(_buffer) - _length ? length - written : sizeof(_buffer) - _length;
+                memcpy(_buffer + _length, data + written, count);
+                _length += count;
+                written += count;
+            }
+            return length;
+        }
+
+        // Sends what is left, false if anything failed to send
+        bool Finish()
+        {
+            _flushBuffer();
+            return !_failed;
+        }
+
+        // True once some bytes were handed to the socket, so the server may have seen the request
+        bool SentAny() const { return _sentAny; }
+
+    private:
+        void _flushBuffer()
+        {
+            if (_length > 0 && !_failed)
+            {
+                size_t written = _client.write(_buffer, _length);
+                _failed = written != _length;
+                _sentAny = _sentAny || written > 0;
+            }
+            _length = 0;
+        }
 
-DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *channelId, const char *content)
+        Client &_client;
+        uint8_t _buffer[DISCORD_ESP_SEND_CHUNK_SIZE];
+        size_t _length = 0;
+        bool _failed = false;
+        bool _sentAny = false;
+    };
+}
+
+DiscordESPResponse DiscordESPClient::BotApi::_sendMessage(const char *token, const char *channelId, const char *content, DiscordESPCallback *callback)
 {
     if (token == nullptr || strlen(token) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 1);
@@ -40,10 +98,10 @@ DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *c
     doc[F("content")] = content;
     char url[256];
     snprintf(url, sizeof(url), BASE_DISCORD_API_URL "channels/%s/messages", channelId);
-    return _sendRequest(token, url, "POST", doc);
+    return _client._sendRequest(token, url, "POST", doc, callback);
 }
 
-DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *channelId, DiscordMessageBuilder &builder)
+DiscordESPResponse DiscordESPClient::BotApi::_sendMessage(const char *token, const char *channelId, DiscordMessageBuilder &builder, DiscordESPCallback *callback)
 {
     if (token == nullptr || strlen(token) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 1);
@@ -51,25 +109,32 @@ DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *c
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 2);
     if (WiFi.status() != WL_CONNECTED)
         return DiscordESPResponse(DiscordESPResponseCode::WifiNotConnected);
-    if (builder.IsComponentV2())
-    {
-        if (builder.GetComponents().empty())
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 5);
-        if (!builder.GetEmbeds().empty() || builder.GetContent().has_value())
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 6);
-    }
-    else
-    {
-        if (builder.GetEmbeds().size() > 10)
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 7);
-    }
-    JsonDocument doc = _build(builder, false);
+    if (int invalidParameter = _client._validate(builder))
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, invalidParameter);
+    JsonDocument doc = _client._build(builder, false);
     char url[256];
     snprintf(url, sizeof(url), BASE_DISCORD_API_URL "channels/%s/messages", channelId);
-    return _sendRequest(token, url, "POST", doc);
+    return _client._sendRequest(token, url, "POST", doc, callback);
 }
 
-DiscordESPResponse DiscordESP::Bot::AddReaction(const char *token, const char *channelId, const char *messageId, const char *emoji)
+DiscordESPResponse DiscordESPClient::BotApi::_sendMessage(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback *callback)
+{
+    if (token == nullptr || strlen(token) == 0)
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 1);
+    if (channelId == nullptr || strlen(channelId) == 0)
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 2);
+    if (WiFi.status() != WL_CONNECTED)
+        return DiscordESPResponse(DiscordESPResponseCode::WifiNotConnected);
+    if (messageTemplate._forWebhook)
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 13);
+    if (int invalidParameter = messageTemplate._getInvalidParameter())
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, invalidParameter);
+    char url[256];
+    snprintf(url, sizeof(url), BASE_DISCORD_API_URL "channels/%s/messages", channelId);
+    return _client._sendRequest(token, url, "POST", messageTemplate, callback);
+}
+
+DiscordESPResponse DiscordESPClient::BotApi::_addReaction(const char *token, const char *channelId, const char *messageId, const char *emoji, DiscordESPCallback *callback)
 {
     if (token == nullptr || strlen(token) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 1);
@@ -84,15 +149,15 @@ DiscordESPResponse DiscordESP::Bot::AddReaction(const char *token, const char *c
 
     char encodedEmoji[64] = {0};
     if (strchr(emoji, ':') == nullptr)
-        _urlEncode(emoji, encodedEmoji);
+        _client._urlEncode(emoji, encodedEmoji);
     else 
         strcpy(encodedEmoji, emoji);
     char url[256];
     snprintf(url, sizeof(url), BASE_DISCORD_API_URL "channels/%s/messages/%s/reactions/%s/@me", channelId, messageId, encodedEmoji);
-    return _sendRequest(token, url, "PUT", JsonDocument());
+    return _client._sendRequest(token, url, "PUT", JsonDocument(), callback);
 }
 
-DiscordESPResponse DiscordESP::Bot::GetMessages(const char *token, const char *channelId, const char *around, const char *before, const char *after, int limit)
+DiscordESPResponse DiscordESPClient::BotApi::_getMessages(const char *token, const char *channelId, const char *around, const char *before, const char *after, int limit, DiscordESPCallback *callback)
 {
     if (token == nullptr || strlen(token) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 1);
@@ -135,29 +200,19 @@ DiscordESPResponse DiscordESP::Bot::GetMessages(const char *token, const char *c
     char limitStr[4];
     snprintf(limitStr, sizeof(limitStr), "%d", limit);
     strcat(url, limitStr);
-    return _sendRequest(token, url, "GET", JsonDocument());
+    return _client._sendRequest(token, url, "GET", JsonDocument(), callback);
 }
 
 // Add thread id to the webhook url as ?thread_id=THREAD_ID to send message to a thread
 // Pass threadName to create a new thread with that name
-DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs)
+DiscordESPResponse DiscordESPClient::WebhookApi::_sendMessage(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs, DiscordESPCallback *callback)
 {
     if (webhookUrl == nullptr || strlen(webhookUrl) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 12);
     if (WiFi.status() != WL_CONNECTED)
         return DiscordESPResponse(DiscordESPResponseCode::WifiNotConnected);
-    if (builder.IsComponentV2())
-    {
-        if (builder.GetComponents().empty())
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 5);
-        if (!builder.GetEmbeds().empty() || builder.GetContent().has_value())
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 6);
-    }
-    else
-    {
-        if (builder.GetEmbeds().size() > 10)
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 7);
-    }
+    if (int invalidParameter = _client._validate(builder))
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, invalidParameter);
     char webhookUrlBuffer[256];
     strncpy(webhookUrlBuffer, webhookUrl, sizeof(webhookUrlBuffer) - 1);
     webhookUrlBuffer[sizeof(webhookUrlBuffer) - 1] = '\0';
@@ -170,7 +225,7 @@ DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, Disc
     }
     if (builder.IsComponentV2())
         strcat(webhookUrlBuffer, "&with_components=true");
-    JsonDocument doc = _build(builder, true);
+    JsonDocument doc = _client._build(builder, true);
     if (threadName != nullptr && strlen(threadName) > 0)
     {
         doc[F("thread_name")] = threadName;
@@ -178,29 +233,44 @@ DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, Disc
         for (const uint64_t &tagID : tagIDs)
             tagIDsArray.add(tagID);
     }
-    return _sendRequest("", webhookUrlBuffer, "POST", doc);
+    return _client._sendRequest("", webhookUrlBuffer, "POST", doc, callback);
 }
 
-// Add thread id to the webhook url as ?thread_id=THREAD_ID to send message to a thread
-// Pass threadName to create a new thread with that name
-DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs)
+DiscordESPResponse DiscordESPClient::WebhookApi::_sendMessage(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback *callback)
 {
     if (webhookUrl == nullptr || strlen(webhookUrl) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 12);
     if (WiFi.status() != WL_CONNECTED)
         return DiscordESPResponse(DiscordESPResponseCode::WifiNotConnected);
-    if (builder.IsComponentV2())
-    {
-        if (builder.GetComponents().empty())
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 5);
-        if (!builder.GetEmbeds().empty() || builder.GetContent().has_value())
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 6);
-    }
-    else
+    if (!messageTemplate._forWebhook)
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 13);
+    if (int invalidParameter = messageTemplate._getInvalidParameter())
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, invalidParameter);
+    char webhookUrlBuffer[256];
+    strncpy(webhookUrlBuffer, webhookUrl, sizeof(webhookUrlBuffer) - 1);
+    webhookUrlBuffer[sizeof(webhookUrlBuffer) - 1] = '\0';
+    if (strstr(webhookUrl, "wait=true") == nullptr)
     {
-        if (builder.GetEmbeds().size() > 10)
-            return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 7);
+        if (strchr(webhookUrl, '?') == nullptr)
+            strcat(webhookUrlBuffer, "?wait=true");
+        else
+            strcat(webhookUrlBuffer, "&wait=true");
     }
+    if (messageTemplate.IsComponentV2())
+        strcat(webhookUrlBuffer, "&with_components=true");
+    return _client._sendRequest("", webhookUrlBuffer, "POST", messageTemplate, callback);
+}
+
+// Add thread id to the webhook url as ?thread_id=THREAD_ID to send message to a thread
+// Pass threadName to create a new thread with that name
+DiscordESPResponse DiscordESPClient::WebhookApi::SendMessageNoWait(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs)
+{
+    if (webhookUrl == nullptr || strlen(webhookUrl) == 0)
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 12);
+    if (WiFi.status() != WL_CONNECTED)
+        return DiscordESPResponse(DiscordESPResponseCode::WifiNotConnected);
+    if (int invalidParameter = _client._validate(builder))
+        return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, invalidParameter);
 
     char webhookUrlBuffer[256];
     strncpy(webhookUrlBuffer, webhookUrl, sizeof(webhookUrlBuffer) - 1);
@@ -212,7 +282,7 @@ DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl
         else
             strcat(webhookUrlBuffer, "&with_components=true");
     }
-    JsonDocument doc = _build(builder, true);
+    JsonDocument doc = _client._build(builder, true);
     if (threadName != nullptr && strlen(threadName) > 0)
     {
         doc[F("thread_name")] = threadName;
@@ -220,10 +290,10 @@ DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl
         for (const uint64_t &tagID : tagIDs)
             tagIDsArray.add(tagID);
     }
-    return _sendRequest("", webhookUrlBuffer, "POST", doc);
+    return _client._sendRequest("", webhookUrlBuffer, "POST", doc, nullptr);
 }
 
-DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs)
+DiscordESPResponse DiscordESPClient::WebhookApi::_sendMessage(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs, DiscordESPCallback *callback)
 {
     if (webhookUrl == nullptr || strlen(webhookUrl) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 12);
@@ -254,10 +324,10 @@ DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, cons
         for (const uint64_t &tagID : tagIDs)
             tagIDsArray.add(tagID);
     }
-    return _sendRequest("", webhookUrlBuffer, "POST", doc);
+    return _client._sendRequest("", webhookUrlBuffer, "POST", doc, callback);
 }
 
-DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs)
+DiscordESPResponse DiscordESPClient::WebhookApi::SendMessageNoWait(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs)
 {
     if (webhookUrl == nullptr || strlen(webhookUrl) == 0)
         return DiscordESPResponse(DiscordESPResponseCode::InvalidParameter, 12);
@@ -278,62 +348,124 @@ DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl
         for (const uint64_t &tagID : tagIDs)
             tagIDsArray.add(tagID);
     }
-    return _sendRequest("", webhookUrl, "POST", doc);
+    return _client._sendRequest("", webhookUrl, "POST", doc, nullptr);
+}
+
+DiscordRateLimitBudget DiscordESPClient::BotApi::GetSendMessageBudget(const char *channelId)
+{
+    char url[256];
+    snprintf(url, sizeof(url), BASE_DISCORD_API_URL "channels/%s/messages", channelId);
+    return _client.GetRateLimitBudget("POST", url);
 }
 
 // ---------------------------------------------------------------
 
-DiscordESPResponse DiscordESP::_sendRequest(const char *token, const char *url, const char *method, JsonDocument doc)
+DiscordESPResponse DiscordESPClient::_sendRequest(const char *token, const char *url, const char *method, const JsonDocument &doc, DiscordESPCallback *callback)
 {
-    if (!_httpClient.begin(_wifiClient, url))
-        return DiscordESPResponse(DiscordESPResponseCode::HttpConnectionFailed);
-    if (token != nullptr && strlen(token) > 0) 
-    {
-        char authHeader[128];
-        snprintf(authHeader, sizeof(authHeader), "Bot %s", token);
-        _httpClient.addHeader("Authorization", authHeader);
-    }
-    _httpClient.addHeader("Content-Type", "application/json");
-    const char *keys[] = {"Transfer-Encoding"};
-    _httpClient.collectHeaders(keys, 1);
-    String jsonString;
-    if (!doc.isNull())
-        serializeJson(doc, jsonString);
-    int httpResponseCode = _httpClient.sendRequest(method, jsonString);
-    if (httpResponseCode < 0)
+    if (callback != nullptr)
+        return _enqueue(token, url, method, doc, String(), std::move(*callback));
+    if (doc.isNull())
+        return _sendRequestBody(token, url, method, nullptr);
+    JsonRequestBody body(doc);
+    return _sendRequestBody(token, url, method, &body);
+}
+
+DiscordESPResponse DiscordESPClient::_sendRequest(const char *token, const char *url, const char *method, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback *callback)
+{
+    // The values may change before the request goes out, so a queued one keeps its own copy
+    if (callback != nullptr)
+        return _enqueue(token, url, method, JsonDocument(), messageTemplate.ToString(), std::move(*callback));
+    return _sendRequestBody(token, url, method, &messageTemplate);
+}
+
+DiscordESPResponse DiscordESPClient::_sendRequestBody(const char *token, const char *url, const char *method, const RequestBody *body)
+{
+    // The connection is shared: let the asynchronous request in flight finish first. Its
+    // callback is left to the next Loop(), not run from inside this call.
+    while (_asyncState == AsyncState::AwaitingResponse)
     {
-        _httpClient.end();
-        return DiscordESPResponse(static_cast<DiscordESPResponseCode>(httpResponseCode));
+        _pollAsyncRequest();
+        delay(1);
     }
-    if (httpResponseCode == 204)
+    DiscordRateLimitRoute route = DiscordRateLimiter::GetRoute(method, url);
+    unsigned long wait = _rateLimiter.GetWaitTime(route);
+    if (wait > 0)
     {
-        _httpClient.end();
-        return DiscordESPResponse(DiscordESPResponseCode::NoContent);
+        if (_rateLimitPolicy == DiscordRateLimitPolicy::Reject || wait > _rateLimitMaxWaitMs)
+        {
+            DiscordESPResponse response(DiscordESPResponseCode::LocalRateLimited);
+            response.rateLimitRemaining = 0;
+            response.rateLimitResetInMs = wait;
+            return response;
+        }
+        delay(wait);
     }
-    JsonDocument responseDoc;
-    DeserializationError error;
-    if (strcasecmp(_httpClient.header("Transfer-Encoding").c_str(), "chunked") == 0)
+    _rateLimiter.OnRequest(route);
+    bool reused = _prepareConnection(url);
+    DiscordESPResponse response = _sendRequestOnce(token, url, method, body);
+    // The server may have closed the kept-alive connection in the meantime: reconnect once
+    if (reused && _canResend(method, response.errorCode))
     {
-        StreamUtils::ChunkDecodingStream decodedStream(_httpClient.getStream());
-        if (_currentFilter.has_value())
-            error = deserializeJson(responseDoc, decodedStream, _currentFilter.value());
-        else
-            error = deserializeJson(responseDoc, decodedStream);
+        _wifiClient.stop();
+        reused = false;
+        response = _sendRequestOnce(token, url, method, body);
     }
-    else
+    response.connectionReused = reused;
+    DiscordRateLimitBudget budget = _rateLimiter.GetBudget(route);
+    response.rateLimitRemaining = budget.remaining;
+    response.rateLimitResetInMs = budget.resetInMs;
+    _lastRequestTime = millis();
+    return response;
+}
+
+// Returns true if the open connection can be reused for url. Connections to another host or
+// idle for too long are closed first.
+bool DiscordESPClient::_prepareConnection(const char *url)
+{
+    char host[sizeof(_connectedHost)] = {0};
+    const char *start = strstr(url, "://");
+    start = start == nullptr ? url : start + 3;
+    size_t length = strcspn(start, ":/?");
+    if (length >= sizeof(host))
+        length = sizeof(host) - 1;
+    memcpy(host, start, length);
+    bool reusable = _keepAlive && _wifiClient.connected() && strcmp(host, _connectedHost) == 0 && millis() - _lastRequestTime < _keepAliveIdleMs;
+    if (!reusable && _wifiClient.connected())
+        _wifiClient.stop();
+    strcpy(_connectedHost, host);
+    return reusable;
+}
+
+DiscordESPResponse DiscordESPClient::_sendRequestOnce(const char *token, const char *url, const char *method, const RequestBody *body)
+{
+    DiscordESPResponseCode error = _writeRequest(token, url, method, body);
+    if (error == DiscordESPResponseCode::Success)
+        error = _awaitResponse();
+    if (error != DiscordESPResponseCode::Success)
     {
-        if (_currentFilter.has_value())
-            error = deserializeJson(responseDoc, _httpClient.getString(), _currentFilter.value());
-        else
-            error = deserializeJson(responseDoc, _httpClient.getString());
+        _wifiClient.stop();
+        return DiscordESPResponse(error);
     }
-    _httpClient.end();
-    if (error.code() != 0)
+    return _readResponse(DiscordRateLimiter::GetRoute(method, url));
+}
+
+// Blocks until the first bytes of the response are in
+DiscordESPResponseCode DiscordESPClient::_awaitResponse()
+{
+    unsigned long start = millis();
+    while (_wifiClient.available() <= 0)
     {
-        char buffer[64];
-        snprintf(buffer, sizeof(buffer), "JSON deserialization failed: %s (%d)", error.c_str(), error.code());
-        return DiscordESPResponse(DiscordESPResponseCode::JsonDeserializationFailed, String(buffer));
+        if (!_wifiClient.connected())
+            return DiscordESPResponseCode::HttpConnectionLost;
+        if (millis() - start > DISCORD_ESP_ASYNC_TIMEOUT_MS)
+            return DiscordESPResponseCode::HttpReadTimeout;
+        delay(1);
     }
+    return DiscordESPResponseCode::Success;
+}
+
+DiscordESPResponse DiscordESPClient::_toResponse(int httpResponseCode, JsonDocument &responseDoc)
+{
     if (httpResponseCode == 200 || httpResponseCode == 201)
         return DiscordESPResponse(responseDoc);
     if (httpResponseCode == 204)
@@ -353,7 +485,259 @@ DiscordESPResponse DiscordESP::_sendRequest(const char *token, const char *url,
     return DiscordESPResponse(DiscordESPResponseCode::UnknownError, responseDoc);
 }
 
-JsonDocument DiscordESP::_build(DiscordMessageBuilder &builder, bool forWebhook)
+// Whether a request that failed with error on a kept-alive connection can be sent again. Once the
+// headers are out the server may have acted on it, so only idempotent methods are repeated then.
+bool DiscordESPClient::_canResend(const char *method, DiscordESPResponseCode error)
+{
+    if (error == DiscordESPResponseCode::HttpSendHeaderFailed)
+        return true;
+    if (error != DiscordESPResponseCode::HttpSendPayloadFailed && error != DiscordESPResponseCode::HttpConnectionLost)
+        return false;
+    return strcmp(method, "GET") == 0 || strcmp(method, "PUT") == 0 || strcmp(method, "DELETE") == 0;
+}
+
+DeserializationError DiscordESPClient::_deserialize(JsonDocument &doc, Stream &stream)
+{
+    if (_currentFilter.has_value())
+        return deserializeJson(doc, stream, _currentFilter.value());
+    return deserializeJson(doc, stream);
+}
+
+// ---------------------------------------------------------------
+// Asynchronous requests: written like the blocking ones, then Loop() checks for the response
+// without blocking until its first bytes arrive.
+
+void DiscordESPClient::Loop()
+{
+    bool polled = _asyncState == AsyncState::AwaitingResponse;
+    if (polled)
+        _pollAsyncRequest();
+    // Also delivers a response that a blocking request read while waiting for the connection
+    if (_asyncResponse.has_value())
+    {
+        DiscordESPResponse response = std::move(_asyncResponse.value());
+        _asyncResponse.reset();
+        _completeAsyncRequest(response);
+        return;
+    }
+    if (polled || _asyncCount == 0)
+        return;
+    const AsyncRequest &request = _asyncQueue[_asyncHead];
+    unsigned long wait = _rateLimiter.GetWaitTime(DiscordRateLimiter::GetRoute(request.method, request.url.c_str()));
+    if (wait > 0)
+    {
+        if (_rateLimitPolicy == DiscordRateLimitPolicy::Reject || wait > _rateLimitMaxWaitMs)
+        {
+            _asyncReused = false;
+            DiscordESPResponse response(DiscordESPResponseCode::LocalRateLimited);
+            _completeAsyncRequest(response);
+        }
+        // Otherwise retried on a later Loop() instead of blocking it
+        return;
+    }
+    _startAsyncRequest();
+}
+
+DiscordESPResponse DiscordESPClient::_enqueue(const char *token, const char *url, const char *method, const JsonDocument &doc, String body, DiscordESPCallback callback)
+{
+    if (_asyncCount == DISCORD_ESP_ASYNC_QUEUE_SIZE)
+        return DiscordESPResponse(DiscordESPResponseCode::AsyncQueueFull);
+    AsyncRequest &request = _asyncQueue[(_asyncHead + _asyncCount) % DISCORD_ESP_ASYNC_QUEUE_SIZE];
+    request.token = token;
+    request.url = url;
+    request.method = method;
+    request.doc = doc;
+    request.body = std::move(body);
+    request.callback = std::move(callback);
+    _asyncCount++;
+    return DiscordESPResponse(DiscordESPResponseCode::Queued);
+}
+
+void DiscordESPClient::_startAsyncRequest()
+{
+    const AsyncRequest &request = _asyncQueue[_asyncHead];
+    _rateLimiter.OnRequest(DiscordRateLimiter::GetRoute(request.method, request.url.c_str()));
+    _asyncReused = _prepareConnection(request.url.c_str());
+    DiscordESPResponseCode error = _writeAsyncRequest(request);
+    // The server may have closed the kept-alive connection in the meantime: reconnect once
+    if (_asyncReused && _canResend(request.method, error))
+    {
+        _wifiClient.stop();
+        _asyncReused = false;
+        error = _writeAsyncRequest(request);
+    }
+    if (error != DiscordESPResponseCode::Success)
+    {
+        _wifiClient.stop();
+        DiscordESPResponse response(error);
+        _completeAsyncRequest(response);
+        return;
+    }
+    _asyncState = AsyncState::AwaitingResponse;
+    _asyncStartTime = millis();
+}
+
+DiscordESPResponseCode DiscordESPClient::_writeAsyncRequest(const AsyncRequest &request)
+{
+    if (!request.body.isEmpty())
+    {
+        StringRequestBody body(request.body);
+        return _writeRequest(request.token.c_str(), request.url.c_str(), request.method, &body);
+    }
+    if (!request.doc.isNull())
+    {
+        JsonRequestBody body(request.doc);
+        return _writeRequest(request.token.c_str(), request.url.c_str(), request.method, &body);
+    }
+    return _writeRequest(request.token.c_str(), request.url.c_str(), request.method, nullptr);
+}
+
+// Writes the request line, headers and body on the connection to _connectedHost, opened first
+// if needed. Each part goes out in chunks of DISCORD_ESP_SEND_CHUNK_SIZE bytes.
+DiscordESPResponseCode DiscordESPClient::_writeRequest(const char *token, const char *url, const char *method, const RequestBody *body)
+{
+    if (!_wifiClient.connected() && !_wifiClient.connect(_connectedHost, 443))
+        return DiscordESPResponseCode::HttpConnectionFailed;
+    const char *path = strstr(url, "://");
+    path = path == nullptr ? nullptr : strchr(path + 3, '/');
+    BufferedClientWriter out(_wifiClient);
+    out.print(method);
+    out.print(' ');
+    out.print(path == nullptr ? "/" : path);
+    out.print(F(" HTTP/1.1\r\nHost: "));
+    out.print(_connectedHost);
+    out.print(F("\r\nUser-Agent: " DISCORD_ESP_USER_AGENT "\r\nConnection: "));
+    out.print(_keepAlive ? F("keep-alive") : F("close"));
+    if (token != nullptr && token[0] != '\0')
+    {
+        out.print(F("\r\nAuthorization: Bot "));
+        out.print(token);
+    }
+    out.print(F("\r\nContent-Type: application/json\r\nContent-Length: "));
+    out.print(body == nullptr ? 0 : body->GetSize());
+    out.print(F("\r\n\r\n"));
+    if (body != nullptr)
+        body->WriteTo(out);
+    if (out.Finish())
+        return DiscordESPResponseCode::Success;
+    return out.SentAny() ? DiscordESPResponseCode::HttpSendPayloadFailed : DiscordESPResponseCode::HttpSendHeaderFailed;
+}
+
+// Reads the response once it is in, or fails the request, and leaves the result in
+// _asyncResponse for Loop() to hand to the callback
+void DiscordESPClient::_pollAsyncRequest()
+{
+    if (_wifiClient.available() > 0)
+    {
+        _asyncState = AsyncState::Idle;
+        const AsyncRequest &request = _asyncQueue[_asyncHead];
+        _asyncResponse = _readResponse(DiscordRateLimiter::GetRoute(request.method, request.url.c_str()));
+        // The connection was last used now, not when the callback runs
+        _lastRequestTime = millis();
+        return;
+    }
+    DiscordESPResponseCode error;
+    if (!_wifiClient.connected())
+        error = DiscordESPResponseCode::HttpConnectionLost;
+    else if (millis() - _asyncStartTime > DISCORD_ESP_ASYNC_TIMEOUT_MS)
+        error = DiscordESPResponseCode::HttpReadTimeout;
+    else
+        return;
+    _wifiClient.stop();
+    _asyncState = AsyncState::Idle;
+    // A kept-alive connection closed by the server before it answered: the request stays at the
+    // front of the queue and goes out again on a new connection, if that is harmless
+    if (_asyncReused && _canResend(_asyncQueue[_asyncHead].method, error))
+        return;
+    _asyncResponse = DiscordESPResponse(error);
+}
+
+DiscordESPResponse DiscordESPClient::_readResponse(DiscordRateLimitRoute route)
+{
+    String line = _wifiClient.readStringUntil('\n');
+    if (!line.startsWith(F("HTTP/1.")) || line.length() < 12)
+    {
+        _wifiClient.stop();
+        return DiscordESPResponse(DiscordESPResponseCode::HttpNotAHttpServer);
+    }
+    int httpResponseCode = line.substring(9, 12).toInt();
+    bool close = !_keepAlive || line[7] == '0';
+    bool chunked = false;
+    long contentLength = -1;
+    String bucket, remaining, resetAfter, retryAfter, global, scope;
+    for (;;)
+    {
+        line = _wifiClient.readStringUntil('\n');
+        line.trim();
+        if (line.isEmpty())
+            break;
+        int separator = line.indexOf(':');
+        if (separator <= 0)
+            continue;
+        String name = line.substring(0, separator);
+        String value = line.substring(separator + 1);
+        value.trim();
+        if (name.equalsIgnoreCase(F("Content-Length")))
+            contentLength = value.toInt();
+        else if (name.equalsIgnoreCase(F("Transfer-Encoding")))
+            chunked = value.equalsIgnoreCase(F("chunked"));
+        else if (name.equalsIgnoreCase(F("Connection")))
+            close = close || value.equalsIgnoreCase(F("close"));
+        else if (name.equalsIgnoreCase(F("X-RateLimit-Bucket")))
+            bucket = value;
+        else if (name.equalsIgnoreCase(F("X-RateLimit-Remaining")))
+            remaining = value;
+        else if (name.equalsIgnoreCase(F("X-RateLimit-Reset-After")))
+            resetAfter = value;
+        else if (name.equalsIgnoreCase(F("Retry-After")))
+            retryAfter = value;
+        else if (name.equalsIgnoreCase(F("X-RateLimit-Global")))
+            global = value;
+        else if (name.equalsIgnoreCase(F("X-RateLimit-Scope")))
+            scope = value;
+    }
+    _rateLimiter.OnResponse(route, httpResponseCode, bucket.c_str(), remaining.c_str(), resetAfter.c_str(), retryAfter.c_str(), global.c_str(), scope.c_str());
+    JsonDocument responseDoc;
+    DeserializationError error;
+    if (httpResponseCode != 204 && (chunked || contentLength != 0))
+    {
+        ResponseBodyStream body(_wifiClient, chunked, contentLength);
+        error = _deserialize(responseDoc, body);
+        // Whatever follows the JSON (the terminating chunk, a trailing newline) would prefix the
+        // next response on a kept-alive connection, so the connection is only kept once the end
+        // of the body has been read
+        close = close || error.code() != 0 || !body.Finish();
+    }
+    if (close)
+        _wifiClient.stop();
+    if (error.code() != 0)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "JSON deserialization failed: %s (%d)", error.c_str(), error.code());
+        return DiscordESPResponse(DiscordESPResponseCode::JsonDeserializationFailed, String(buffer));
+    }
+    return _toResponse(httpResponseCode, responseDoc);
+}
+
+// Pops the request at the front of the queue and hands response to its callback, which may
+// queue new requests
+void DiscordESPClient::_completeAsyncRequest(DiscordESPResponse &response)
+{
+    AsyncRequest &request = _asyncQueue[_asyncHead];
+    DiscordESPCallback callback = std::move(request.callback);
+    DiscordRateLimitBudget budget = _rateLimiter.GetBudget(DiscordRateLimiter::GetRoute(request.method, request.url.c_str()));
+    request = AsyncRequest();
+    _asyncHead = (_asyncHead + 1) % DISCORD_ESP_ASYNC_QUEUE_SIZE;
+    _asyncCount--;
+    _lastRequestTime = millis();
+    response.connectionReused = _asyncReused;
+    response.rateLimitRemaining = budget.remaining;
+    response.rateLimitResetInMs = budget.resetInMs;
+    if (callback)
+        callback(response);
+}
+
+JsonDocument DiscordESPClient::_build(DiscordMessageBuilder &builder, bool forWebhook)
 {
     JsonDocument doc;
     bool isComponentV2 = builder.IsComponentV2();
@@ -402,7 +786,25 @@ JsonDocument DiscordESP::_build(DiscordMessageBuilder &builder, bool forWebhook)
     return doc;
 }
 
-void DiscordESP::_urlEncode(const char *str, char *buffer)
+// Parameter reported by InvalidParameter when builder is not a valid message, else 0
+int DiscordESPClient::_validate(DiscordMessageBuilder &builder)
+{
+    if (builder.IsComponentV2())
+    {
+        if (builder.GetComponents().empty())
+            return 5;
+        if (!builder.GetEmbeds().empty() || builder.GetContent().has_value())
+            return 6;
+    }
+    else
+    {
+        if (builder.GetEmbeds().size() > 10)
+            return 7;
+    }
+    return 0;
+}
+
+void DiscordESPClient::_urlEncode(const char *str, char *buffer)
 {
     char buf[4];
     for (size_t i = 0; i < strlen(str); i++)
@@ -418,15 +820,49 @@ void DiscordESP::_urlEncode(const char *str, char *buffer)
     }
 }
 
-void DiscordESP::SetupClient()
+void DiscordESPClient::Setup()
 {
 #if defined(ESP8266)
     _wifiClient.setTrustAnchors(new BearSSL::X509List(DISCORD_COM_CA));
     _wifiClient.setBufferSizes(4096, 2048);
-    _httpClient.setUserAgent("DiscordBot (https://github.com/ElectroHeavenVN/IoT_Libraries/tree/main/DiscordESP, 1.0), ESP8266HTTPClient");
 #elif defined(ESP32)
     _wifiClient.setCACert(DISCORD_COM_CA);
-    _httpClient.setUserAgent("DiscordBot (https://github.com/ElectroHeavenVN/IoT_Libraries/tree/main/DiscordESP, 1.0), ESP32HTTPClient");
 #endif
-    _httpClient.setTimeout(5000);
-}
\ No newline at end of file
+}
+
+void DiscordESPClient::SetKeepAlive(bool enabled, unsigned long idleTimeoutMs)
+{
+    _keepAlive = enabled;
+    _keepAliveIdleMs = idleTimeoutMs;
+    if (!enabled)
+        _wifiClient.stop();
+}
+
+// ---------------------------------------------------------------
+
+DiscordESPClient &DiscordESP::GetDefaultClient()
+{
+    static DiscordESPClient client;
+    return client;
+}
+
+DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs) { return GetDefaultClient().Webhook.SendMessage(webhookUrl, builder, threadName, tagIDs); }
+DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs) { return GetDefaultClient().Webhook.SendMessage(webhookUrl, content, username, avatarUrl, threadName, tagIDs); }
+DiscordESPResponse DiscordESP::Webhook::SendMessage(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate) { return GetDefaultClient().Webhook.SendMessage(webhookUrl, messageTemplate); }
+DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs) { return GetDefaultClient().Webhook.SendMessageNoWait(webhookUrl, builder, threadName, tagIDs); }
+DiscordESPResponse DiscordESP::Webhook::SendMessageNoWait(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs) { return GetDefaultClient().Webhook.SendMessageNoWait(webhookUrl, content, username, avatarUrl, threadName, tagIDs); }
+DiscordESPResponse DiscordESP::Webhook::SendMessageAsync(const char *webhookUrl, DiscordMessageBuilder &builder, DiscordESPCallback callback, const char *threadName, vector<uint64_t> tagIDs) { return GetDefaultClient().Webhook.SendMessageAsync(webhookUrl, builder, callback, threadName, tagIDs); }
+DiscordESPResponse DiscordESP::Webhook::SendMessageAsync(const char *webhookUrl, const char *content, DiscordESPCallback callback, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs) { return GetDefaultClient().Webhook.SendMessageAsync(webhookUrl, content, callback, username, avatarUrl, threadName, tagIDs); }
+DiscordESPResponse DiscordESP::Webhook::SendMessageAsync(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback callback) { return GetDefaultClient().Webhook.SendMessageAsync(webhookUrl, messageTemplate, callback); }
+
+DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *channelId, const char *content) { return GetDefaultClient().Bot.SendMessage(token, channelId, content); }
+DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *channelId, DiscordMessageBuilder &builder) { return GetDefaultClient().Bot.SendMessage(token, channelId, builder); }
+DiscordESPResponse DiscordESP::Bot::SendMessage(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate) { return GetDefaultClient().Bot.SendMessage(token, channelId, messageTemplate); }
+DiscordESPResponse DiscordESP::Bot::AddReaction(const char *token, const char *channelId, const char *messageId, const char *emoji) { return GetDefaultClient().Bot.AddReaction(token, channelId, messageId, emoji); }
+DiscordESPResponse DiscordESP::Bot::GetMessages(const char *token, const char *channelId, const char *around, const char *before, const char *after, int limit) { return GetDefaultClient().Bot.GetMessages(token, channelId, around, before, after, limit); }
+DiscordESPResponse DiscordESP::Bot::SendMessageAsync(const char *token, const char *channelId, const char *content, DiscordESPCallback callback) { return GetDefaultClient().Bot.SendMessageAsync(token, channelId, content, callback); }
+DiscordESPResponse DiscordESP::Bot::SendMessageAsync(const char *token, const char *channelId, DiscordMessageBuilder &builder, DiscordESPCallback callback) { return GetDefaultClient().Bot.SendMessageAsync(token, channelId, builder, callback); }
+DiscordESPResponse DiscordESP::Bot::SendMessageAsync(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback callback) { return GetDefaultClient().Bot.SendMessageAsync(token, channelId, messageTemplate, callback); }
+DiscordESPResponse DiscordESP::Bot::AddReactionAsync(const char *token, const char *channelId, const char *messageId, const char *emoji, DiscordESPCallback callback) { return GetDefaultClient().Bot.AddReactionAsync(token, channelId, messageId, emoji, callback); }
+DiscordESPResponse DiscordESP::Bot::GetMessagesAsync(const char *token, const char *channelId, DiscordESPCallback callback, const char *around, const char *before, const char *after, int limit) { return GetDefaultClient().Bot.GetMessagesAsync(token, channelId, callback, around, before, after, limit); }
+DiscordRateLimitBudget DiscordESP::Bot::GetSendMessageBudget(const char *channelId) { return GetDefaultClient().Bot.GetSendMessageBudget(channelId); }
@@ -5,22 +5,293 @@
 #include <WiFiClientSecure.h>
 #if defined(ESP8266)
 #include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
 #elif defined(ESP32)
 #include <WiFi.h>
-#include <HTTPClient.h>
 #endif
+#include <functional>
 #include <optional>
 #include "DiscordMessageBuilder.hpp"
 #include "DiscordESPResponse.h"
 #include "DiscordComponent.hpp"
+#include "DiscordRateLimiter.hpp"
+
+// Idle time after which a kept-alive connection is closed instead of reused. Servers drop idle
+// connections on their own, and writing to one of those costs a failed request first.
+#ifndef DISCORD_ESP_KEEP_ALIVE_IDLE_MS
+#define DISCORD_ESP_KEEP_ALIVE_IDLE_MS 30000
+#endif
+
+// Asynchronous requests that can be queued, including the one in flight
+#ifndef DISCORD_ESP_ASYNC_QUEUE_SIZE
+#define DISCORD_ESP_ASYNC_QUEUE_SIZE 4
+#endif
+
+// Time a request waits for the first byte of its response
+#ifndef DISCORD_ESP_ASYNC_TIMEOUT_MS
+#define DISCORD_ESP_ASYNC_TIMEOUT_MS 5000
+#endif
+
+using DiscordESPCallback = std::function<void(DiscordESPResponse &)>;
+
+class DiscordMessageTemplate;
+class RequestBody;
+
+// One connection to Discord with its own keep-alive state, rate limit table, asynchronous queue
+// and JSON filter. Separate clients can be used in parallel, e.g. one per FreeRTOS task on ESP32.
+// The static DiscordESP API uses a default client.
+//
+//     DiscordESPClient alerts;
+//     alerts.Setup();
+//     alerts.Webhook.SendMessage(ALERT_WEBHOOK_URL, "Door opened");
+class DiscordESPClient
+{
+public:
+    class WebhookApi
+    {
+    public:
+        WebhookApi(DiscordESPClient &client) : _client(client) {}
+
+        DiscordESPResponse SendMessage(String webhookUrl, DiscordMessageBuilder &builder, String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessage(webhookUrl.c_str(), builder, threadName.c_str(), tagIDs); }
+        DiscordESPResponse SendMessage(String webhookUrl, String content, String username = "", String avatarUrl = "", String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessage(webhookUrl.c_str(), content.c_str(), username.c_str(), avatarUrl.c_str(), threadName.c_str(), tagIDs); }
+        DiscordESPResponse SendMessage(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName = "", vector<uint64_t> tagIDs = {}) { return _sendMessage(webhookUrl, builder, threadName, tagIDs, nullptr); }
+        DiscordESPResponse SendMessage(const char *webhookUrl, const char *content, const char *username = "", const char *avatarUrl = "", const char *threadName = "", vector<uint64_t> tagIDs = {}) { return _sendMessage(webhookUrl, content, username, avatarUrl, threadName, tagIDs, nullptr); }
+        DiscordESPResponse SendMessage(String webhookUrl, const DiscordMessageTemplate &messageTemplate) { return SendMessage(webhookUrl.c_str(), messageTemplate); }
+        DiscordESPResponse SendMessage(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate) { return _sendMessage(webhookUrl, messageTemplate, nullptr); }
+
+        DiscordESPResponse SendMessageNoWait(String webhookUrl, DiscordMessageBuilder &builder, String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessageNoWait(webhookUrl.c_str(), builder, threadName.c_str(), tagIDs); }
+        DiscordESPResponse SendMessageNoWait(String webhookUrl, String content, String username = "", String avatarUrl = "", String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessageNoWait(webhookUrl.c_str(), content.c_str(), username.c_str(), avatarUrl.c_str(), threadName.c_str(), tagIDs); }
+        DiscordESPResponse SendMessageNoWait(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName = "", vector<uint64_t> tagIDs = {});
+        DiscordESPResponse SendMessageNoWait(const char *webhookUrl, const char *content, const char *username = "", const char *avatarUrl = "", const char *threadName = "", vector<uint64_t> tagIDs = {});
+
+        // Same as the blocking versions, but queue the request and return Queued (or the validation
+        // error, or AsyncQueueFull) at once. callback gets the response from Loop(), see there for
+        // what can still block.
+        DiscordESPResponse SendMessageAsync(const char *webhookUrl, DiscordMessageBuilder &builder, DiscordESPCallback callback = nullptr, const char *threadName = "", vector<uint64_t> tagIDs = {}) { return _sendMessage(webhookUrl, builder, threadName, tagIDs, &callback); }
+        DiscordESPResponse SendMessageAsync(const char *webhookUrl, const char *content, DiscordESPCallback callback = nullptr, const char *username = "", const char *avatarUrl = "", const char *threadName = "", vector<uint64_t> tagIDs = {}) { return _sendMessage(webhookUrl, content, username, avatarUrl, threadName, tagIDs, &callback); }
+        DiscordESPResponse SendMessageAsync(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback callback = nullptr) { return _sendMessage(webhookUrl, messageTemplate, &callback); }
+
+        DiscordRateLimitBudget GetSendMessageBudget(const char *webhookUrl) { return _client.GetRateLimitBudget("POST", webhookUrl); }
+    
+    private:
+        // Shared by the blocking and asynchronous versions: a null callback sends the request now,
+        // otherwise it is queued with *callback
+        DiscordESPResponse _sendMessage(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName, vector<uint64_t> tagIDs, DiscordESPCallback *callback);
+        DiscordESPResponse _sendMessage(const char *webhookUrl, const char *content, const char *username, const char *avatarUrl, const char *threadName, vector<uint64_t> tagIDs, DiscordESPCallback *callback);
+        DiscordESPResponse _sendMessage(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback *callback);
+
+        DiscordESPClient &_client;
+    };
+
+    class BotApi
+    {
+    public:
+        BotApi(DiscordESPClient &client) : _client(client) {}
+
+        DiscordESPResponse SendMessage(String token, String channelId, String content) { return SendMessage(token.c_str(), channelId.c_str(), content.c_str()); }
+        DiscordESPResponse SendMessage(const char *token, const char *channelId, const char *content) { return _sendMessage(token, channelId, content, nullptr); }
+        DiscordESPResponse SendMessage(const char *token, uint64_t channelId, const char *content)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return SendMessage(token, channelIdStr, content);
+        }
+        DiscordESPResponse SendMessage(String token, uint64_t channelId, String content)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return SendMessage(token.c_str(), channelIdStr, content.c_str());
+        }
+        
+        DiscordESPResponse SendMessage(String token, String channelId, DiscordMessageBuilder &builder) { return SendMessage(token.c_str(), channelId.c_str(), builder); }
+        DiscordESPResponse SendMessage(const char *token, const char *channelId, DiscordMessageBuilder &builder) { return _sendMessage(token, channelId, builder, nullptr); }
+        DiscordESPResponse SendMessage(const char *token, uint64_t channelId, DiscordMessageBuilder &builder)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return SendMessage(token, channelIdStr, builder);
+        }
+        DiscordESPResponse SendMessage(String token, uint64_t channelId, DiscordMessageBuilder &builder) 
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return SendMessage(token.c_str(), channelIdStr, builder);
+        }
+
+        DiscordESPResponse SendMessage(String token, String channelId, const DiscordMessageTemplate &messageTemplate) { return SendMessage(token.c_str(), channelId.c_str(), messageTemplate); }
+        DiscordESPResponse SendMessage(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate) { return _sendMessage(token, channelId, messageTemplate, nullptr); }
+        DiscordESPResponse SendMessage(const char *token, uint64_t channelId, const DiscordMessageTemplate &messageTemplate)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return SendMessage(token, channelIdStr, messageTemplate);
+        }
+
+        DiscordESPResponse AddReaction(String token, String channelId, String messageId, String emoji) { return AddReaction(token.c_str(), channelId.c_str(), messageId.c_str(), emoji.c_str()); }
+        DiscordESPResponse AddReaction(const char *token, const char *channelId, const char *messageId, const char *emoji) { return _addReaction(token, channelId, messageId, emoji, nullptr); }
+        DiscordESPResponse AddReaction(const char *token, uint64_t channelId, uint64_t messageId, const char *emoji) 
+        {
+            char channelIdStr[21];
+            char messageIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            snprintf(messageIdStr, sizeof(messageIdStr), "%llu", messageId);
+            return AddReaction(token, channelIdStr, messageIdStr, emoji);
+        }
+        DiscordESPResponse AddReaction(String token, uint64_t channelId, uint64_t messageId, String emoji) 
+        {
+            char channelIdStr[21];
+            char messageIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            snprintf(messageIdStr, sizeof(messageIdStr), "%llu", messageId);
+            return AddReaction(token.c_str(), channelIdStr, messageIdStr, emoji.c_str());
+        }
+        
+        DiscordESPResponse GetMessages(String token, String channelId, String around = "", String before = "", String after = "", int limit = 50) { return GetMessages(token.c_str(), channelId.c_str(), around.c_str(), before.c_str(), after.c_str(), limit); }
+        DiscordESPResponse GetMessages(const char *token, const char *channelId, const char *around = "", const char *before = "", const char *after = "", int limit = 50) { return _getMessages(token, channelId, around, before, after, limit, nullptr); }
+        DiscordESPResponse GetMessages(String token, uint64_t channelId, String around = "", String before = "", String after = "", int limit = 50) 
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return GetMessages(token.c_str(), channelIdStr, around.c_str(), before.c_str(), after.c_str(), limit);
+        }
+
+        // Same as the blocking versions, but queue the request and return Queued (or the validation
+        // error, or AsyncQueueFull) at once. callback gets the response from Loop(), see there for
+        // what can still block.
+        DiscordESPResponse SendMessageAsync(const char *token, const char *channelId, const char *content, DiscordESPCallback callback = nullptr) { return _sendMessage(token, channelId, content, &callback); }
+        DiscordESPResponse SendMessageAsync(const char *token, const char *channelId, DiscordMessageBuilder &builder, DiscordESPCallback callback = nullptr) { return _sendMessage(token, channelId, builder, &callback); }
+        DiscordESPResponse SendMessageAsync(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback callback = nullptr) { return _sendMessage(token, channelId, messageTemplate, &callback); }
+        DiscordESPResponse AddReactionAsync(const char *token, const char *channelId, const char *messageId, const char *emoji, DiscordESPCallback callback = nullptr) { return _addReaction(token, channelId, messageId, emoji, &callback); }
+        DiscordESPResponse GetMessagesAsync(const char *token, const char *channelId, DiscordESPCallback callback, const char *around = "", const char *before = "", const char *after = "", int limit = 50) { return _getMessages(token, channelId, around, before, after, limit, &callback); }
+
+        DiscordRateLimitBudget GetSendMessageBudget(const char *channelId);
+        DiscordRateLimitBudget GetSendMessageBudget(uint64_t channelId)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return GetSendMessageBudget(channelIdStr);
+        }
+    
+    private:
+        // Shared by the blocking and asynchronous versions: a null callback sends the request now,
+        // otherwise it is queued with *callback
+        DiscordESPResponse _sendMessage(const char *token, const char *channelId, const char *content, DiscordESPCallback *callback);
+        DiscordESPResponse _sendMessage(const char *token, const char *channelId, DiscordMessageBuilder &builder, DiscordESPCallback *callback);
+        DiscordESPResponse _sendMessage(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback *callback);
+        DiscordESPResponse _addReaction(const char *token, const char *channelId, const char *messageId, const char *emoji, DiscordESPCallback *callback);
+        DiscordESPResponse _getMessages(const char *token, const char *channelId, const char *around, const char *before, const char *after, int limit, DiscordESPCallback *callback);
+
+        DiscordESPClient &_client;
+    };
+
+    DiscordESPClient() = default;
+    // The Webhook and Bot members point back to their client
+    DiscordESPClient(const DiscordESPClient &) = delete;
+    DiscordESPClient &operator=(const DiscordESPClient &) = delete;
+
+    void Setup();
+    void SetJSONFilter(DeserializationOption::Filter filter) { _currentFilter = filter; }
+    void ClearJSONFilter() { _currentFilter = std::nullopt; }
+    // Keeps the TLS connection open between requests (enabled by default), so consecutive
+    // requests skip the handshake
+    void SetKeepAlive(bool enabled, unsigned long idleTimeoutMs = DISCORD_ESP_KEEP_ALIVE_IDLE_MS);
+    // What to do with a request whose rate limit bucket is known to be empty
+    void SetRateLimitPolicy(DiscordRateLimitPolicy policy, unsigned long maxWaitMs = DISCORD_ESP_RATE_LIMIT_MAX_WAIT_MS)
+    {
+        _rateLimitPolicy = policy;
+        _rateLimitMaxWaitMs = maxWaitMs;
+    }
+    // Budget left for the route of a request, as last reported by Discord
+    DiscordRateLimitBudget GetRateLimitBudget(const char *method, const char *url) const { return _rateLimiter.GetBudget(DiscordRateLimiter::GetRoute(method, url)); }
+
+    // Drives the asynchronous requests (the *Async methods). Call it from loop(), or schedule it
+    // with MainThreadDispatcher::DispatchRepeating. Waiting for the response does not block, but
+    // two steps still do, so one call can stall for:
+    // - the TLS connect when a request starts without a kept-alive connection, typically 1-2 s
+    //   on ESP32 and up to the TCP connect timeout when Discord does not answer;
+    // - reading the response once its first bytes are in: the headers and JSON are parsed in one
+    //   go, and every read that stalls waits up to the socket's read timeout before the response
+    //   fails. Normally the whole response is in within a few milliseconds of its first byte.
+    void Loop();
+    // Asynchronous requests queued or in flight
+    size_t GetQueuedCount() const { return _asyncCount; }
+
+    WebhookApi Webhook{*this};
+    BotApi Bot{*this};
+
+private:
+    struct AsyncRequest
+    {
+        String token;
+        String url;
+        const char *method = nullptr;
+        JsonDocument doc;
+        // Serialized body of a template, sent instead of doc
+        String body;
+        DiscordESPCallback callback;
+    };
+
+    enum class AsyncState : uint8_t
+    {
+        Idle,
+        AwaitingResponse,
+    };
+
+    friend class DiscordMessageTemplate;
+
+    static JsonDocument _build(DiscordMessageBuilder &builder, bool forWebhook);
+    static int _validate(DiscordMessageBuilder &builder);
+    static void _urlEncode(const char* str, char* buffer);
+    // Sends the request now when callback is null, else queues it for Loop()
+    DiscordESPResponse _sendRequest(const char* token, const char* url, const char* method, const JsonDocument &doc, DiscordESPCallback *callback);
+    DiscordESPResponse _sendRequest(const char* token, const char* url, const char* method, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback *callback);
+    DiscordESPResponse _sendRequestBody(const char* token, const char* url, const char* method, const RequestBody *body);
+    DiscordESPResponse _sendRequestOnce(const char* token, const char* url, const char* method, const RequestBody *body);
+    DiscordESPResponseCode _writeRequest(const char* token, const char* url, const char* method, const RequestBody *body);
+    DiscordESPResponseCode _awaitResponse();
+    DiscordESPResponse _readResponse(DiscordRateLimitRoute route);
+    bool _prepareConnection(const char* url);
+    static DiscordESPResponse _toResponse(int httpResponseCode, JsonDocument &responseDoc);
+    static bool _canResend(const char* method, DiscordESPResponseCode error);
+    DeserializationError _deserialize(JsonDocument &doc, Stream &stream);
+    DiscordESPResponse _enqueue(const char* token, const char* url, const char* method, const JsonDocument &doc, String body, DiscordESPCallback callback);
+    void _startAsyncRequest();
+    DiscordESPResponseCode _writeAsyncRequest(const AsyncRequest &request);
+    void _pollAsyncRequest();
+    void _completeAsyncRequest(DiscordESPResponse &response);
+    WiFiClientSecure _wifiClient;
+    std::optional<DeserializationOption::Filter> _currentFilter = std::nullopt;
+    bool _keepAlive = true;
+    unsigned long _keepAliveIdleMs = DISCORD_ESP_KEEP_ALIVE_IDLE_MS;
+    unsigned long _lastRequestTime = 0;
+    char _connectedHost[64] = "";
+    DiscordRateLimiter _rateLimiter;
+    DiscordRateLimitPolicy _rateLimitPolicy = DiscordRateLimitPolicy::Wait;
+    unsigned long _rateLimitMaxWaitMs = DISCORD_ESP_RATE_LIMIT_MAX_WAIT_MS;
+    AsyncRequest _asyncQueue[DISCORD_ESP_ASYNC_QUEUE_SIZE];
+    size_t _asyncHead = 0;
+    size_t _asyncCount = 0;
+    AsyncState _asyncState = AsyncState::Idle;
+    // Response of the request at the front of the queue, not handed to its callback yet
+    std::optional<DiscordESPResponse> _asyncResponse = std::nullopt;
+    unsigned long _asyncStartTime = 0;
+    bool _asyncReused = false;
+};
 
 class DiscordESP
 {
 public:
-    static void SetupClient();
-    static void SetJSONFilter(DeserializationOption::Filter filter) { _currentFilter = filter; }
-    static void ClearJSONFilter() { _currentFilter = std::nullopt; }
+    // The client behind the static API
+    static DiscordESPClient &GetDefaultClient();
+
+    static void SetupClient() { GetDefaultClient().Setup(); }
+    static void SetJSONFilter(DeserializationOption::Filter filter) { GetDefaultClient().SetJSONFilter(filter); }
+    static void ClearJSONFilter() { GetDefaultClient().ClearJSONFilter(); }
+    static void SetKeepAlive(bool enabled, unsigned long idleTimeoutMs = DISCORD_ESP_KEEP_ALIVE_IDLE_MS) { GetDefaultClient().SetKeepAlive(enabled, idleTimeoutMs); }
+    static void SetRateLimitPolicy(DiscordRateLimitPolicy policy, unsigned long maxWaitMs = DISCORD_ESP_RATE_LIMIT_MAX_WAIT_MS) { GetDefaultClient().SetRateLimitPolicy(policy, maxWaitMs); }
+    static DiscordRateLimitBudget GetRateLimitBudget(const char *method, const char *url) { return GetDefaultClient().GetRateLimitBudget(method, url); }
+    // e.g. MainThreadDispatcher::DispatchRepeating(DiscordESP::Loop, 10)
+    static void Loop() { GetDefaultClient().Loop(); }
+    static size_t GetQueuedCount() { return GetDefaultClient().GetQueuedCount(); }
 
     struct Webhook
     {
@@ -28,11 +299,21 @@ public:
         static DiscordESPResponse SendMessage(String webhookUrl, String content, String username = "", String avatarUrl = "", String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessage(webhookUrl.c_str(), content.c_str(), username.c_str(), avatarUrl.c_str(), threadName.c_str(), tagIDs); }
         static DiscordESPResponse SendMessage(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName = "", vector<uint64_t> tagIDs = {});
         static DiscordESPResponse SendMessage(const char *webhookUrl, const char *content, const char *username = "", const char *avatarUrl = "", const char *threadName = "", vector<uint64_t> tagIDs = {});
+        static DiscordESPResponse SendMessage(String webhookUrl, const DiscordMessageTemplate &messageTemplate) { return SendMessage(webhookUrl.c_str(), messageTemplate); }
+        static DiscordESPResponse SendMessage(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate);
 
         static DiscordESPResponse SendMessageNoWait(String webhookUrl, DiscordMessageBuilder &builder, String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessageNoWait(webhookUrl.c_str(), builder, threadName.c_str(), tagIDs); }
         static DiscordESPResponse SendMessageNoWait(String webhookUrl, String content, String username = "", String avatarUrl = "", String threadName = "", vector<uint64_t> tagIDs = {}) { return SendMessageNoWait(webhookUrl.c_str(), content.c_str(), username.c_str(), avatarUrl.c_str(), threadName.c_str(), tagIDs); }
         static DiscordESPResponse SendMessageNoWait(const char *webhookUrl, DiscordMessageBuilder &builder, const char *threadName = "", vector<uint64_t> tagIDs = {});
         static DiscordESPResponse SendMessageNoWait(const char *webhookUrl, const char *content, const char *username = "", const char *avatarUrl = "", const char *threadName = "", vector<uint64_t> tagIDs = {});
+
+        // Same as the blocking versions, but queue the request and return Queued (or the validation
+        // error, or AsyncQueueFull) at once. callback gets the response from DiscordESP::Loop().
+        static DiscordESPResponse SendMessageAsync(const char *webhookUrl, DiscordMessageBuilder &builder, DiscordESPCallback callback = nullptr, const char *threadName = "", vector<uint64_t> tagIDs = {});
+        static DiscordESPResponse SendMessageAsync(const char *webhookUrl, const char *content, DiscordESPCallback callback = nullptr, const char *username = "", const char *avatarUrl = "", const char *threadName = "", vector<uint64_t> tagIDs = {});
+        static DiscordESPResponse SendMessageAsync(const char *webhookUrl, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback callback = nullptr);
+
+        static DiscordRateLimitBudget GetSendMessageBudget(const char *webhookUrl) { return GetRateLimitBudget("POST", webhookUrl); }
     };
 
     struct Bot 
@@ -67,6 +348,15 @@ public:
             return SendMessage(token.c_str(), channelIdStr, builder);
         }
 
+        static DiscordESPResponse SendMessage(String token, String channelId, const DiscordMessageTemplate &messageTemplate) { return SendMessage(token.c_str(), channelId.c_str(), messageTemplate); }
+        static DiscordESPResponse SendMessage(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate);
+        static DiscordESPResponse SendMessage(const char *token, uint64_t channelId, const DiscordMessageTemplate &messageTemplate)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return SendMessage(token, channelIdStr, messageTemplate);
+        }
+
         static DiscordESPResponse AddReaction(String token, String channelId, String messageId, String emoji) { return AddReaction(token.c_str(), channelId.c_str(), messageId.c_str(), emoji.c_str()); }
         static DiscordESPResponse AddReaction(const char *token, const char *channelId, const char *messageId, const char *emoji);
         static DiscordESPResponse AddReaction(const char *token, uint64_t channelId, uint64_t messageId, const char *emoji) 
@@ -94,13 +384,21 @@ public:
             snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
             return GetMessages(token.c_str(), channelIdStr, around.c_str(), before.c_str(), after.c_str(), limit);
         }
-    };
 
-private:
-    static JsonDocument _build(DiscordMessageBuilder &builder, bool forWebhook);
-    static void _urlEncode(const char* str, char* buffer);
-    static DiscordESPResponse _sendRequest(const char* token, const char* url, const char* method, JsonDocument doc);
-    static WiFiClientSecure _wifiClient;
-    static HTTPClient _httpClient;
-    static std::optional<DeserializationOption::Filter> _currentFilter;
+        // Same as the blocking versions, but queue the request and return Queued (or the validation
+        // error, or AsyncQueueFull) at once. callback gets the response from DiscordESP::Loop().
+        static DiscordESPResponse SendMessageAsync(const char *token, const char *channelId, const char *content, DiscordESPCallback callback = nullptr);
+        static DiscordESPResponse SendMessageAsync(const char *token, const char *channelId, DiscordMessageBuilder &builder, DiscordESPCallback callback = nullptr);
+        static DiscordESPResponse SendMessageAsync(const char *token, const char *channelId, const DiscordMessageTemplate &messageTemplate, DiscordESPCallback callback = nullptr);
+        static DiscordESPResponse AddReactionAsync(const char *token, const char *channelId, const char *messageId, const char *emoji, DiscordESPCallback callback = nullptr);
+        static DiscordESPResponse GetMessagesAsync(const char *token, const char *channelId, DiscordESPCallback callback, const char *around = "", const char *before = "", const char *after = "", int limit = 50);
+
+        static DiscordRateLimitBudget GetSendMessageBudget(const char *channelId);
+        static DiscordRateLimitBudget GetSendMessageBudget(uint64_t channelId)
+        {
+            char channelIdStr[21];
+            snprintf(channelIdStr, sizeof(channelIdStr), "%llu", channelId);
+            return GetSendMessageBudget(channelIdStr);
+        }
+    };
 };
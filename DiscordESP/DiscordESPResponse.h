@@ -23,6 +23,9 @@ enum class DiscordESPResponseCode : int
     WifiNotConnected,
     InvalidResponse,
     JsonDeserializationFailed,
+    LocalRateLimited,
+    Queued,
+    AsyncQueueFull,
 
     // HTTP status codes
     NoContent = 204,
@@ -41,6 +44,11 @@ struct DiscordESPResponse
 public:
     DiscordESPResponseCode errorCode;
     JsonDocument responseData;
+    // True when the request went over a kept-alive connection instead of a new TLS handshake
+    bool connectionReused = false;
+    // Rate limit budget of the request's route after it completed, -1 / 0 when unknown
+    int rateLimitRemaining = -1;
+    unsigned long rateLimitResetInMs = 0;
     
     DiscordESPResponse(JsonDocument doc) : errorCode(DiscordESPResponseCode::Success), responseData(doc) { }
     DiscordESPResponse(DiscordESPResponseCode code, JsonDocument doc) : errorCode(code), responseData(doc) { }
@@ -109,6 +117,8 @@ public:
                         return "Only one of around, before, or after can be specified";
                     case 12:
                         return "Webhook URL is empty";
+                    case 13:
+                        return "Message template was built for the other API (webhook or bot)";
                 }
                 return "Invalid parameter";
             }
@@ -118,6 +128,12 @@ public:
                 return "Invalid response from server";
             case DiscordESPResponseCode::JsonDeserializationFailed:
                 return "JSON deserialization failed";
+            case DiscordESPResponseCode::LocalRateLimited:
+                return "Rate limit bucket empty, request not sent";
+            case DiscordESPResponseCode::Queued:
+                return "Request queued";
+            case DiscordESPResponseCode::AsyncQueueFull:
+                return "Asynchronous request queue is full";
 
             case DiscordESPResponseCode::NoContent:
                 return "No Content";
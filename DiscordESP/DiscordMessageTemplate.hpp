@@ -0,0 +1,236 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DiscordESP.hpp"
+#include "RequestBody.hpp"
+
+// Placeholders a template can have, {{0}} to {{DISCORD_ESP_TEMPLATE_SLOTS - 1}}
+#ifndef DISCORD_ESP_TEMPLATE_SLOTS
+#define DISCORD_ESP_TEMPLATE_SLOTS 8
+#endif
+
+// A message serialized once, with {{0}}, {{1}}... placeholders in its strings left as slots to
+// fill before each send. Sending streams the stored JSON with the escaped values in between, so
+// a message that only changes by a few values is not rebuilt into a JsonDocument every time.
+// Placeholders work in any string of the message: content, embed titles, field values, URLs...
+//
+//     DiscordMessageBuilder builder;
+//     builder.AddEmbed(DiscordEmbed().WithTitle("Greenhouse").WithDescription("{{0}} °C, {{1}} %"));
+//     DiscordMessageTemplate status(builder, true);
+//     ...
+//     status.Set(0, String(temperature, 1)).Set(1, String(humidity, 0));
+//     DiscordESP::Webhook::SendMessage(WEBHOOK_URL, status);
+class DiscordMessageTemplate : public RequestBody
+{
+public:
+    // forWebhook picks what the builder would send to a webhook rather than as a bot, the two
+    // differ slightly. The template can only be sent with the API it was built for.
+    DiscordMessageTemplate(DiscordMessageBuilder &builder, bool forWebhook) : _isComponentV2(builder.IsComponentV2()), _forWebhook(forWebhook), _invalidParameter(DiscordESPClient::_validate(builder))
+    {
+        String json;
+        serializeJson(BuildDocument(builder, forWebhook), json);
+        _compile(json.c_str());
+        optional<String> content = builder.GetContent();
+        if (content.has_value())
+            _compileContent(content->c_str());
+    }
+
+    // Sets the text of {{slot}} for the following sends. Unset slots are empty. Sends fail with
+    // InvalidParameter 4 while the values make the content longer than 2000 characters.
+    DiscordMessageTemplate &Set(uint8_t slot, const char *value)
+    {
+        if (slot >= DISCORD_ESP_TEMPLATE_SLOTS)
+            return *this;
+        String &escaped = _values[slot];
+        escaped = "";
+        size_t length = value == nullptr ? 0 : strlen(value);
+        _contentLength += _contentUses[slot] * length;
+        _contentLength -= _contentUses[slot] * _valueLengths[slot];
+        _valueLengths[slot] = length;
+        if (value == nullptr)
+            return *this;
+        escaped.reserve(length);
+        for (const char *c = value; *c != '\0'; c++)
+            _appendEscaped(escaped, *c);
+        return *this;
+    }
+
+    DiscordMessageTemplate &Set(uint8_t slot, const String &value) { return Set(slot, value.c_str()); }
+
+    // Length of the JSON body with the current values
+    size_t GetSize() const override
+    {
+        size_t size = _text.length();
+        for (const Slot &slot : _slots)
+            size += _values[slot.index].length();
+        return size;
+    }
+
+    // Writes the JSON body with the current values, which must not change meanwhile
+    void WriteTo(Print &out) const override
+    {
+        const char *data;
+        size_t length;
+        for (size_t i = 0; _getPiece(i, data, length); i++)
+        {
+            if (length > 0)
+                out.write(reinterpret_cast<const uint8_t *>(data), length);
+        }
+    }
+
+    // The JSON body with the current values
+    String ToString() const
+    {
+        String result;
+        result.reserve(GetSize());
+        const char *data;
+        size_t length;
+        for (size_t i = 0; _getPiece(i, data, length); i++)
+        {
+            for (size_t j = 0; j < length; j++)
+                result += data[j];
+        }
+        return result;
+    }
+
+    bool IsComponentV2() const { return _isComponentV2; }
+    bool IsForWebhook() const { return _forWebhook; }
+
+    // The document SendMessage(builder) serializes into the request on every send, and the
+    // template is compiled from
+    static JsonDocument BuildDocument(DiscordMessageBuilder &builder, bool forWebhook) { return DiscordESPClient::_build(builder, forWebhook); }
+
+private:
+    friend class DiscordESPClient;
+
+    struct Slot
+    {
+        // Position in _text the value goes to
+        size_t offset;
+        uint8_t index;
+    };
+
+    // End of the placeholder at c and its slot, nullptr if c does not start one. Anything that
+    // only looks like a placeholder, e.g. {{99}} past the last slot, is kept as text.
+    static const char *_parsePlaceholder(const char *c, uint8_t &index)
+    {
+        if (c[0] != '{' || c[1] != '{' || !isdigit(static_cast<uint8_t>(c[2])))
+            return nullptr;
+        char *end;
+        unsigned long slot = strtoul(c + 2, &end, 10);
+        if (end[0] != '}' || end[1] != '}' || slot >= DISCORD_ESP_TEMPLATE_SLOTS)
+            return nullptr;
+        index = static_cast<uint8_t>(slot);
+        return end + 2;
+    }
+
+    // Keeps the JSON without its placeholders and remembers where they were
+    void _compile(const char *json)
+    {
+        _text.reserve(strlen(json));
+        for (const char *c = json; *c != '\0';)
+        {
+            uint8_t index;
+            if (const char *end = _parsePlaceholder(c, index))
+            {
+                _slots.push_back({_text.length(), index});
+                c = end;
+                continue;
+            }
+            _text += *c++;
+        }
+    }
+
+    // Counts the fixed characters of the content and the slots it uses, so Set() can keep its
+    // length up to date
+    void _compileContent(const char *content)
+    {
+        for (const char *c = content; *c != '\0';)
+        {
+            uint8_t index;
+            if (const char *end = _parsePlaceholder(c, index))
+            {
+                _contentUses[index]++;
+                c = end;
+                continue;
+            }
+            _contentLength++;
+            c++;
+        }
+    }
+
+    // Parameter reported by InvalidParameter for the current values, else 0
+    int _getInvalidParameter() const
+    {
+        if (_invalidParameter != 0)
+            return _invalidParameter;
+        return _contentLength > 2000 ? 4 : 0;
+    }
+
+    // Values end up inside JSON strings
+    static void _appendEscaped(String &out, char c)
+    {
+        switch (c)
+        {
+        case '"':
+            out += F("\\\"");
+            break;
+        case '\\':
+            out += F("\\\\");
+            break;
+        case '\n':
+            out += F("\\n");
+            break;
+        case '\r':
+            out += F("\\r");
+            break;
+        case '\t':
+            out += F("\\t");
+            break;
+        default:
+            if (static_cast<uint8_t>(c) < 0x20)
+            {
+                char buffer[7];
+                snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<uint8_t>(c));
+                out += buffer;
+            }
+            else
+                out += c;
+            break;
+        }
+    }
+
+    // Piece 2n is the text before slot n, piece 2n + 1 the value of slot n. False past the end.
+    bool _getPiece(size_t piece, const char *&data, size_t &length) const
+    {
+        size_t slot = piece / 2;
+        if (slot > _slots.size() || (piece % 2 == 1 && slot == _slots.size()))
+            return false;
+        if (piece % 2 == 1)
+        {
+            const String &value = _values[_slots[slot].index];
+            data = value.c_str();
+            length = value.length();
+            return true;
+        }
+        size_t start = slot == 0 ? 0 : _slots[slot - 1].offset;
+        size_t end = slot == _slots.size() ? _text.length() : _slots[slot].offset;
+        data = _text.c_str() + start;
+        length = end - start;
+        return true;
+    }
+
+    String _text;
+    vector<Slot> _slots;
+    String _values[DISCORD_ESP_TEMPLATE_SLOTS];
+    // Unescaped length of each value, as Discord counts it
+    size_t _valueLengths[DISCORD_ESP_TEMPLATE_SLOTS] = {};
+    // Times each slot appears in the content
+    uint8_t _contentUses[DISCORD_ESP_TEMPLATE_SLOTS] = {};
+    // Length of the content with the current values
+    size_t _contentLength = 0;
+    bool _isComponentV2;
+    bool _forWebhook;
+    // Parameter reported by InvalidParameter when the builder was not a valid message, else 0
+    int _invalidParameter;
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Routes and buckets whose rate limit state is remembered, the least recently used ones are
+// forgotten first
+#ifndef DISCORD_ESP_RATE_LIMIT_ROUTES
+#define DISCORD_ESP_RATE_LIMIT_ROUTES 8
+#endif
+
+// Longest a request waits for its bucket to reset under DiscordRateLimitPolicy::Wait before it
+// is rejected instead
+#ifndef DISCORD_ESP_RATE_LIMIT_MAX_WAIT_MS
+#define DISCORD_ESP_RATE_LIMIT_MAX_WAIT_MS 2000
+#endif
+
+enum class DiscordRateLimitPolicy
+{
+    // Fail with LocalRateLimited without touching the network
+    Reject,
+    // Block until the bucket resets, if that is within the maximum wait
+    Wait,
+};
+
+struct DiscordRateLimitBudget
+{
+    // Requests left before the reset, -1 when unknown
+    int remaining = -1;
+    // Milliseconds until the bucket resets, 0 when unknown or already reset
+    unsigned long resetInMs = 0;
+};
+
+// Rate limit identity of a request, see DiscordRateLimiter::GetRoute()
+struct DiscordRateLimitRoute
+{
+    // Method and path template, including the major parameter
+    uint32_t key = 0;
+    // Channel, guild or webhook the limits are scoped to, 0 for none
+    uint32_t majorParameter = 0;
+};
+
+// Remembers the X-RateLimit-* headers Discord returns, so requests into an empty bucket can be
+// held back locally instead of costing a round trip and a 429. Like Discord, it keys routes by
+// method, path template and major parameter (channel, guild or webhook), so one entry covers
+// every message id or emoji on the same route. Once a response names the route's bucket, the
+// budget is kept per bucket and major parameter, shared by all routes in that bucket.
+class DiscordRateLimiter
+{
+public:
+    // e.g. POST .../channels/123/messages/456/reactions/%F0%9F%91%8D/@me is keyed as
+    // POST /api/v10/channels/123/messages/{}/reactions/{}/@me with 123 as its major parameter.
+    // The query string is ignored.
+    static DiscordRateLimitRoute GetRoute(const char *method, const char *url)
+    {
+        DiscordRateLimitRoute route;
+        uint32_t key = _hash(_fnvBasis, method, strlen(method));
+        const char *path = strstr(url, "://");
+        path = path == nullptr ? url : strchr(path + 3, '/');
+        if (path == nullptr)
+            path = "";
+        uint32_t major = _fnvBasis;
+        // Segments of the major parameter still to come: a webhook is its id and token
+        int majorLeft = 0;
+        bool majorSeen = false;
+        const char *previous = "";
+        size_t previousLength = 0;
+        for (const char *segment = path; *segment == '/';)
+        {
+            segment++;
+            size_t length = strcspn(segment, "/?");
+            key = _hash(key, "/", 1);
+            if (majorLeft > 0)
+            {
+                major = _hash(_hash(major, "/", 1), segment, length);
+                key = _hash(key, segment, length);
+                majorLeft--;
+            }
+            else if (_isId(segment, length) || _equals(previous, previousLength, "reactions"))
+                key = _hash(key, "{}", 2);
+            else
+                key = _hash(key, segment, length);
+            if (!majorSeen && majorLeft == 0)
+            {
+                if (_equals(segment, length, "channels") || _equals(segment, length, "guilds"))
+                    majorLeft = 1;
+                else if (_equals(segment, length, "webhooks"))
+                    majorLeft = 2;
+                if (majorLeft > 0)
+                {
+                    majorSeen = true;
+                    major = _hash(major, segment, length);
+                }
+            }
+            previous = segment;
+            previousLength = length;
+            segment += length;
+        }
+        route.key = key;
+        route.majorParameter = majorSeen ? major : 0;
+        return route;
+    }
+
+    // Milliseconds to wait before the route can be used, 0 when it can be used now
+    unsigned long GetWaitTime(DiscordRateLimitRoute route) const
+    {
+        unsigned long now = millis();
+        unsigned long wait = _globalReset.Left(now);
+        const Bucket *bucket = _bucketOf(route);
+        if (bucket != nullptr && bucket->remaining == 0)
+        {
+            unsigned long bucketWait = bucket->reset.Left(now);
+            if (bucketWait > wait)
+                wait = bucketWait;
+        }
+        return wait;
+    }
+
+    DiscordRateLimitBudget GetBudget(DiscordRateLimitRoute route) const
+    {
+        DiscordRateLimitBudget budget;
+        const Bucket *bucket = _bucketOf(route);
+        if (bucket == nullptr)
+            return budget;
+        budget.resetInMs = bucket->reset.Left(millis());
+        // Past the reset the remaining count is stale
+        if (budget.resetInMs > 0)
+            budget.remaining = bucket->remaining;
+        return budget;
+    }
+
+    // Counts a request about to be sent, until the response tells the real remaining count
+    void OnRequest(DiscordRateLimitRoute route)
+    {
+        Bucket *bucket = const_cast<Bucket *>(_bucketOf(route));
+        if (bucket != nullptr && bucket->remaining > 0)
+            bucket->remaining--;
+    }
+
+    // Feeds the headers of a response (empty strings for missing headers)
+    void OnResponse(DiscordRateLimitRoute route, int statusCode, const char *bucketName, const char *remaining, const char *resetAfter, const char *retryAfter, const char *global, const char *scope)
+    {
+        unsigned long now = millis();
+        bool rateLimited = statusCode == 429;
+        bool isGlobal = strcasecmp(global, "true") == 0 || strcasecmp(scope, "global") == 0;
+        if (rateLimited && isGlobal)
+        {
+            _globalReset = Window(now, _secondsToMs(retryAfter));
+            return;
+        }
+        if (*remaining == '\0' && *resetAfter == '\0' && !rateLimited)
+            return;
+        // Until Discord names the bucket, the route is a bucket of its own
+        const Route *known = _find(_routes, route.key);
+        uint32_t bucketKey = known != nullptr ? known->bucket : route.key;
+        if (*bucketName != '\0')
+        {
+            uint32_t majorParameter = route.majorParameter;
+            bucketKey = _hash(_hash(_fnvBasis, bucketName, strlen(bucketName)), reinterpret_cast<const char *>(&majorParameter), sizeof(majorParameter));
+        }
+        // A route moved to another bucket takes that bucket's state
+        _findOrAdd(_routes, route.key).bucket = bucketKey;
+        Bucket &bucket = _findOrAdd(_buckets, bucketKey);
+        if (*remaining != '\0')
+            bucket.remaining = atoi(remaining);
+        if (*resetAfter != '\0')
+            bucket.reset = Window(now, _secondsToMs(resetAfter));
+        if (rateLimited)
+        {
+            bucket.remaining = 0;
+            unsigned long retry = _secondsToMs(retryAfter);
+            if (retry > bucket.reset.Left(now))
+                bucket.reset = Window(now, retry);
+        }
+    }
+
+    void Clear() { *this = DiscordRateLimiter(); }
+
+private:
+    // Start and length rather than an end time, so an old window does not come back to life
+    // when millis() wraps
+    struct Window
+    {
+        unsigned long start = 0;
+        unsigned long length = 0;
+
+        Window() = default;
+        Window(unsigned long start, unsigned long length) : start(start), length(length) {}
+
+        unsigned long Left(unsigned long now) const
+        {
+            unsigned long elapsed = now - start;
+            return elapsed < length ? length - elapsed : 0;
+        }
+    };
+
+    struct Route
+    {
+        uint32_t key = 0;
+        uint32_t bucket = 0;
+        unsigned long lastUsed = 0;
+        bool used = false;
+    };
+
+    struct Bucket
+    {
+        uint32_t key = 0;
+        int remaining = -1;
+        Window reset;
+        unsigned long lastUsed = 0;
+        bool used = false;
+    };
+
+    static constexpr uint32_t _fnvBasis = 2166136261UL;
+
+    // FNV-1a
+    static uint32_t _hash(uint32_t hash, const char *data, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619UL;
+        return hash;
+    }
+
+    static bool _equals(const char *segment, size_t length, const char *literal) { return strlen(literal) == length && strncmp(segment, literal, length) == 0; }
+
+    // Snowflakes and other numeric ids
+    static bool _isId(const char *segment, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            if (segment[i] < '0' || segment[i] > '9')
+                return false;
+        }
+        return length > 0;
+    }
+
+    // Header values are decimal seconds, e.g. "1.337"
+    static unsigned long _secondsToMs(const char *seconds)
+    {
+        if (*seconds == '\0')
+            return 0;
+        double ms = atof(seconds) * 1000.0;
+        return ms > 0 ? static_cast<unsigned long>(ms + 0.999) : 0;
+    }
+
+    template <typename Entry>
+    static const Entry *_find(const Entry (&entries)[DISCORD_ESP_RATE_LIMIT_ROUTES], uint32_t key)
+    {
+        for (const Entry &entry : entries)
+        {
+            if (entry.used && entry.key == key)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    // The least recently used entry is forgotten when the table is full
+    template <typename Entry>
+    static Entry &_findOrAdd(Entry (&entries)[DISCORD_ESP_RATE_LIMIT_ROUTES], uint32_t key)
+    {
+        unsigned long now = millis();
+        Entry *entry = const_cast<Entry *>(_find(entries, key));
+        if (entry == nullptr)
+        {
+            entry = &entries[0];
+            for (Entry &candidate : entries)
+            {
+                if (!candidate.used)
+                {
+                    entry = &candidate;
+                    break;
+                }
+                if (now - candidate.lastUsed > now - entry->lastUsed)
+                    entry = &candidate;
+            }
+            *entry = Entry();
+            entry->key = key;
+            entry->used = true;
+        }
+        entry->lastUsed = now;
+        return *entry;
+    }
+
+    const Bucket *_bucketOf(DiscordRateLimitRoute route) const
+    {
+        const Route *known = _find(_routes, route.key);
+        return known == nullptr ? nullptr : _find(_buckets, known->bucket);
+    }
+
+    Route _routes[DISCORD_ESP_RATE_LIMIT_ROUTES];
+    Bucket _buckets[DISCORD_ESP_RATE_LIMIT_ROUTES];
+    Window _globalReset;
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DiscordESP.hpp"
+
+// Longest a queued line waits before its batch is sent
+#ifndef DISCORD_ESP_BATCH_FLUSH_MS
+#define DISCORD_ESP_BATCH_FLUSH_MS 2000
+#endif
+
+// Packs log lines and fields sent at a high rate into as few webhook messages as Discord's
+// limits allow. Lines fill the message content first, then embed descriptions; fields go into
+// embeds. A batch is sent when the next item does not fit or when its oldest item has waited
+// for the flush interval. Sending goes through the asynchronous queue of a DiscordESPClient, so
+// both Loop() and the client's Loop() have to be called.
+//
+//     DiscordWebhookBatcher logs(WEBHOOK_URL);
+//     logs.AddLine("temperature 23.5");
+//     ...
+//     void loop() { logs.Loop(); DiscordESP::Loop(); }
+class DiscordWebhookBatcher
+{
+public:
+    static constexpr size_t MaxContentLength = 2000;
+    static constexpr size_t MaxEmbeds = 10;
+    static constexpr size_t MaxFieldsPerEmbed = 25;
+    static constexpr size_t MaxDescriptionLength = 4096;
+    static constexpr size_t MaxFieldNameLength = 256;
+    static constexpr size_t MaxFieldValueLength = 1024;
+    static constexpr size_t MaxEmbedsLength = 6000;
+
+    DiscordWebhookBatcher(String webhookUrl, unsigned long flushIntervalMs = DISCORD_ESP_BATCH_FLUSH_MS, DiscordESPClient &client = DiscordESP::GetDefaultClient()) : _webhookUrl(webhookUrl), _flushIntervalMs(flushIntervalMs), _client(&client) {}
+
+    DiscordWebhookBatcher &WithUsername(String username)
+    {
+        _username = username;
+        return *this;
+    }
+
+    // Gets the response of every batch sent
+    DiscordWebhookBatcher &WithCallback(DiscordESPCallback callback)
+    {
+        _callback = callback;
+        return *this;
+    }
+
+    // Queues a line, cut to the content limit. Returns false when a full batch could not be
+    // handed to the client's queue, in which case the line is dropped.
+    bool AddLine(const char *line)
+    {
+        String text = _truncate(line, MaxContentLength);
+        if (text.isEmpty())
+            return true;
+        if (!_tryAddLine(text) && (!Flush() || !_tryAddLine(text)))
+        {
+            _droppedCount++;
+            return false;
+        }
+        _itemAdded();
+        return true;
+    }
+
+    bool AddLine(const String &line) { return AddLine(line.c_str()); }
+
+    // Queues an embed field, name and value cut to their limits. Returns false like AddLine().
+    bool AddField(const char *name, const char *value, bool inlineField = false)
+    {
+        String fieldName = _truncate(name, MaxFieldNameLength);
+        String fieldValue = _truncate(value, MaxFieldValueLength);
+        if (fieldName.isEmpty() || fieldValue.isEmpty())
+            return true;
+        if (!_tryAddField(fieldName, fieldValue, inlineField) && (!Flush() || !_tryAddField(fieldName, fieldValue, inlineField)))
+        {
+            _droppedCount++;
+            return false;
+        }
+        _itemAdded();
+        return true;
+    }
+
+    // Sends the batch once its oldest item has waited for the flush interval
+    void Loop()
+    {
+        if (_itemCount > 0 && millis() - _firstItemTime >= _flushIntervalMs)
+            Flush();
+    }
+
+    // Hands the pending batch to the client's queue. Returns false and keeps the batch when the
+    // queue refused it (full, or WiFi down).
+    bool Flush()
+    {
+        if (_itemCount == 0)
+            return true;
+        DiscordMessageBuilder builder;
+        if (!_content.isEmpty())
+            builder.WithContent(_content);
+        if (!_username.isEmpty())
+            builder.WithUsername(_username);
+        for (size_t i = 0; i < _embedCount; i++)
+        {
+            DiscordEmbed embed;
+            if (!_embeds[i].description.isEmpty())
+                embed.WithDescription(_embeds[i].description);
+            embed.AddFields(_embeds[i].fields);
+            builder.AddEmbed(embed);
+        }
+        DiscordESPResponse response = _client->Webhook.SendMessageAsync(_webhookUrl.c_str(), builder, _callback);
+        if (response.errorCode != DiscordESPResponseCode::Queued)
+            return false;
+        _sentItemCount += _itemCount;
+        _messageCount++;
+        _clear();
+        return true;
+    }
+
+    // Items waiting in the current batch
+    size_t GetPendingCount() const { return _itemCount; }
+    // Items sent so far and the messages they took, their ratio being the batching gain
+    uint32_t GetSentItemCount() const { return _sentItemCount; }
+    uint32_t GetMessageCount() const { return _messageCount; }
+    // Items refused because a full batch could not be sent
+    uint32_t GetDroppedCount() const { return _droppedCount; }
+
+private:
+    struct PendingEmbed
+    {
+        String description;
+        vector<DiscordEmbedField> fields;
+    };
+
+    // Cuts text to at most maxLength bytes without splitting a UTF-8 sequence. Discord counts
+    // characters, which are never more than bytes.
+    static String _truncate(const char *text, size_t maxLength)
+    {
+        size_t length = text == nullptr ? 0 : strlen(text);
+        if (length > maxLength)
+        {
+            length = maxLength;
+            while (length > 0 && (static_cast<uint8_t>(text[length]) & 0xC0) == 0x80)
+                length--;
+        }
+        String result;
+        result.reserve(length);
+        for (size_t i = 0; i < length; i++)
+            result += text[i];
+        return result;
+    }
+
+    bool _tryAddLine(const String &line)
+    {
+        size_t separator = _content.isEmpty() ? 0 : 1;
+        if (_content.length() + separator + line.length() <= MaxContentLength)
+        {
+            if (separator > 0)
+                _content += '\n';
+            _content += line;
+            return true;
+        }
+        // Content full: continue in the description of the last embed, or a new one
+        if (_embedCount > 0)
+        {
+            PendingEmbed &embed = _embeds[_embedCount - 1];
+            separator = embed.description.isEmpty() ? 0 : 1;
+            if (embed.description.length() + separator + line.length() <= MaxDescriptionLength && _embedsLength + separator + line.length() <= MaxEmbedsLength)
+            {
+                if (separator > 0)
+                    embed.description += '\n';
+                embed.description += line;
+                _embedsLength += separator + line.length();
+                return true;
+            }
+        }
+        if (_embedCount == MaxEmbeds || _embedsLength + line.length() > MaxEmbedsLength)
+            return false;
+        _embeds[_embedCount++].description = line;
+        _embedsLength += line.length();
+        return true;
+    }
+
+    bool _tryAddField(const String &name, const String &value, bool inlineField)
+    {
+        size_t length = name.length() + value.length();
+        if (_embedsLength + length > MaxEmbedsLength)
+            return false;
+        if (_embedCount == 0 || _embeds[_embedCount - 1].fields.size() == MaxFieldsPerEmbed)
+        {
+            if (_embedCount == MaxEmbeds)
+                return false;
+            _embedCount++;
+        }
+        _embeds[_embedCount - 1].fields.push_back(DiscordEmbedField().WithName(name).WithValue(value).SetInline(inlineField));
+        _embedsLength += length;
+        return true;
+    }
+
+    void _itemAdded()
+    {
+        if (_itemCount++ == 0)
+            _firstItemTime = millis();
+    }
+
+    void _clear()
+    {
+        _content = String();
+        for (size_t i = 0; i < _embedCount; i++)
+            _embeds[i] = PendingEmbed();
+        _embedCount = 0;
+        _embedsLength = 0;
+        _itemCount = 0;
+    }
+
+    String _webhookUrl;
+    unsigned long _flushIntervalMs;
+    DiscordESPClient *_client;
+    String _username;
+    DiscordESPCallback _callback;
+    String _content;
+    PendingEmbed _embeds[MaxEmbeds];
+    size_t _embedCount = 0;
+    size_t _embedsLength = 0;
+    size_t _itemCount = 0;
+    unsigned long _firstItemTime = 0;
+    uint32_t _sentItemCount = 0;
+    uint32_t _messageCount = 0;
+    uint32_t _droppedCount = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Bytes collected before each write to the connection while a request is sent
+#ifndef DISCORD_ESP_SEND_CHUNK_SIZE
+#define DISCORD_ESP_SEND_CHUNK_SIZE 512
+#endif
+
+// Request body written straight into the connection after the headers, written again from the
+// start when the request goes out on a new connection
+class RequestBody
+{
+public:
+    // Content-Length of the body
+    virtual size_t GetSize() const = 0;
+    virtual void WriteTo(Print &out) const = 0;
+
+protected:
+    ~RequestBody() = default;
+};
+
+// A JsonDocument serialized straight into the connection, never held in full in memory. The
+// document must outlive the body.
+class JsonRequestBody : public RequestBody
+{
+public:
+    JsonRequestBody(const JsonDocument &doc) : _doc(doc), _size(measureJson(doc)) {}
+
+    size_t GetSize() const override { return _size; }
+    void WriteTo(Print &out) const override { serializeJson(_doc, out); }
+
+private:
+    const JsonDocument &_doc;
+    size_t _size;
+};
+
+// A body serialized beforehand, e.g. the copy a queued template request keeps
+class StringRequestBody : public RequestBody
+{
+public:
+    StringRequestBody(const String &text) : _text(text) {}
+
+    size_t GetSize() const override { return _text.length(); }
+    void WriteTo(Print &out) const override { out.write(reinterpret_cast<const uint8_t *>(_text.c_str()), _text.length()); }
+
+private:
+    const String &_text;
+};
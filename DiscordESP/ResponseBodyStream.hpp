@@ -0,0 +1,150 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Read-only Stream over the body of an HTTP response, delimited by Content-Length or sent with
+// Transfer-Encoding: chunked, so the JSON parser never reads into the next response. Every byte
+// is read with the connection's timeout. Finish() consumes whatever the parser left, up to and
+// including the terminating chunk, so a kept-alive connection is left at the next response.
+class ResponseBodyStream : public Stream
+{
+public:
+    // contentLength is ignored for a chunked body; -1 means the body ends when the server closes
+    ResponseBodyStream(Stream &connection, bool chunked, long contentLength) : _connection(connection), _chunked(chunked), _remaining(chunked ? 0 : contentLength) {}
+
+    int available() override
+    {
+        if (_peeked >= 0)
+            return 1;
+        if (_remaining == 0 || _failed)
+            return 0;
+        int available = _connection.available();
+        return _remaining > 0 && available > _remaining ? static_cast<int>(_remaining) : available;
+    }
+
+    int peek() override
+    {
+        if (_peeked >= 0)
+            return _peeked;
+        if (!_fill())
+            return -1;
+        _peeked = _next();
+        if (_peeked < 0)
+            _failed = true;
+        else if (_remaining > 0)
+            _remaining--;
+        return _peeked;
+    }
+
+    int read() override
+    {
+        int c = peek();
+        _peeked = -1;
+        return c;
+    }
+
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+    // Reads the rest of the body. False if its end was not seen (timeout, malformed chunk, or a
+    // body that ends with the connection), in which case the connection cannot be reused.
+    bool Finish()
+    {
+        while (read() >= 0)
+            ;
+        return _ended;
+    }
+
+private:
+    // Next raw byte of the connection, -1 on timeout
+    int _next()
+    {
+        char c;
+        return _connection.readBytes(&c, 1) == 1 ? static_cast<uint8_t>(c) : -1;
+    }
+
+    // Reads one line of chunk framing up to '\n' and parses its leading hex digits into size, -1
+    // if there are none. Returns the line length without CRLF, or -1 on timeout or an oversized
+    // chunk.
+    int _readLine(long &size)
+    {
+        size = -1;
+        int length = 0;
+        bool digits = true;
+        for (;;)
+        {
+            int c = _next();
+            if (c < 0)
+                return -1;
+            if (c == '\n')
+                return length;
+            if (c == '\r')
+                continue;
+            length++;
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digits && digit >= 0)
+            {
+                if (size > 0x7FFFFFF)
+                    return -1;
+                size = (size < 0 ? 0 : size * 16) + digit;
+            }
+            else
+                digits = false;
+        }
+    }
+
+    // True once there is body data to read, false at the end of the body or on a failure
+    bool _fill()
+    {
+        if (_ended || _failed)
+            return false;
+        if (_remaining != 0)
+            return true;
+        if (!_chunked)
+        {
+            _ended = true;
+            return false;
+        }
+        long size;
+        // CRLF closing the previous chunk's data
+        if (_inChunk && _readLine(size) != 0)
+        {
+            _failed = true;
+            return false;
+        }
+        _inChunk = true;
+        if (_readLine(size) <= 0 || size < 0)
+        {
+            _failed = true;
+            return false;
+        }
+        if (size > 0)
+        {
+            _remaining = size;
+            return true;
+        }
+        // Last chunk: trailers up to an empty line
+        for (;;)
+        {
+            int length = _readLine(size);
+            if (length < 0)
+            {
+                _failed = true;
+                return false;
+            }
+            if (length == 0)
+                break;
+        }
+        _ended = true;
+        return false;
+    }
+
+    Stream &_connection;
+    bool _chunked;
+    // Bytes left in the current chunk or the body, -1 for a body that ends with the connection
+    long _remaining;
+    bool _inChunk = false;
+    bool _ended = false;
+    bool _failed = false;
+    int _peeked = -1;
+};
@@ -0,0 +1,89 @@
+// Measures on the board what a DiscordMessageTemplate saves per send over rebuilding the message
+// from a DiscordMessageBuilder, without touching the network. Both sides do what the client does
+// before and while writing the request: size the body for Content-Length, then stream it into a
+// Print that only counts its bytes. The rebuild side builds the document and serializes it twice
+// (measureJson() and serializeJson()), the template side only fills in its slots.
+//
+// The host build has no ArduinoJson, so this only runs on a board; the figures depend on the
+// chip, the clock and the ArduinoJson version.
+
+#include <Arduino.h>
+#include <DiscordESP.hpp>
+#include <DiscordMessageTemplate.hpp>
+#include <RequestBody.hpp>
+
+static const int Iterations = 1000;
+
+class CountingPrint : public Print
+{
+public:
+    size_t write(uint8_t) override
+    {
+        count++;
+        return 1;
+    }
+
+    size_t write(const uint8_t *, size_t size) override
+    {
+        count += size;
+        return size;
+    }
+
+    size_t count = 0;
+    // Sum of the sizes announced beforehand, equal to count
+    size_t sized = 0;
+};
+
+// The message of the example in DiscordMessageTemplate.hpp, with an embed of three fields
+static void BuildStatus(DiscordMessageBuilder &builder, const String &temperature, const String &humidity, const String &uptime)
+{
+    DiscordEmbed embed;
+    embed.WithTitle("Greenhouse").WithDescription("Readings of the last minute").WithColor(0x2ECC71);
+    embed.AddField(DiscordEmbedField().WithName("Temperature").WithValue(temperature + " °C"));
+    embed.AddField(DiscordEmbedField().WithName("Humidity").WithValue(humidity + " %"));
+    embed.AddField(DiscordEmbedField().WithName("Uptime").WithValue(uptime + " s"));
+    builder.AddEmbed(embed);
+}
+
+static void Report(const char *name, unsigned long elapsedUs, const CountingPrint &out)
+{
+    Serial.printf("%-10s %8.1f us/send %6u bytes/send\n", name, static_cast<float>(elapsedUs) / Iterations, static_cast<unsigned>(out.count / Iterations));
+    if (out.sized != out.count)
+        Serial.printf("  sized %u bytes, wrote %u\n", static_cast<unsigned>(out.sized), static_cast<unsigned>(out.count));
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(1000);
+
+    CountingPrint rebuilt;
+    unsigned long start = micros();
+    for (int i = 0; i < Iterations; i++)
+    {
+        DiscordMessageBuilder builder;
+        BuildStatus(builder, String(20 + i % 10), String(40 + i % 30), String(i));
+        JsonDocument doc = DiscordMessageTemplate::BuildDocument(builder, true);
+        JsonRequestBody body(doc);
+        rebuilt.sized += body.GetSize();
+        body.WriteTo(rebuilt);
+    }
+    Report("rebuild", micros() - start, rebuilt);
+
+    DiscordMessageBuilder builder;
+    BuildStatus(builder, "{{0}}", "{{1}}", "{{2}}");
+    DiscordMessageTemplate status(builder, true);
+    CountingPrint filled;
+    start = micros();
+    for (int i = 0; i < Iterations; i++)
+    {
+        status.Set(0, String(20 + i % 10)).Set(1, String(40 + i % 30)).Set(2, String(i));
+        filled.sized += status.GetSize();
+        status.WriteTo(filled);
+    }
+    Report("template", micros() - start, filled);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#ifndef MTD_ISR_ATTR
+#if defined(IRAM_ATTR)
+#define MTD_ISR_ATTR IRAM_ATTR
+#else
+#define MTD_ISR_ATTR
+#endif
+#endif
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+// Every cell carries a sequence number telling producers and consumers whose turn it
+// is, so pushes from interrupt handlers, other FreeRTOS tasks or the second core never
+// take a lock. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class BoundedMpmcQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    BoundedMpmcQueue()
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            _cells[i].sequence.store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue &) = delete;
+    BoundedMpmcQueue &operator=(const BoundedMpmcQueue &) = delete;
+
+    // Returns false when the queue is full
+    template <typename U>
+    MTD_ISR_ATTR bool TryPush(U &&value)
+    {
+        Cell *cell;
+        uint32_t position = _enqueuePosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &_cells[position & (Capacity - 1)];
+            uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(sequence - position);
+            if (diff == 0)
+            {
+                if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                position = _enqueuePosition.load(std::memory_order_relaxed);
+        }
+        cell->data = std::forward<U>(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when the queue is empty
+    bool TryPop(T &value)
+    {
+        Cell *cell;
+        uint32_t position = _dequeuePosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &_cells[position & (Capacity - 1)];
+            uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(sequence - (position + 1));
+            if (diff == 0)
+            {
+                if (_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                position = _dequeuePosition.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(position + Capacity, std::memory_order_release);
+        return true;
+    }
+
+    // Snapshot only, other threads may push or pop concurrently
+    bool IsEmpty() const
+    {
+        return _enqueuePosition.load(std::memory_order_acquire) == _dequeuePosition.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<uint32_t> sequence;
+        T data;
+    };
+
+    Cell _cells[Capacity];
+    std::atomic<uint32_t> _enqueuePosition{0};
+    std::atomic<uint32_t> _dequeuePosition{0};
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "DispatcherFuture.hpp"
+
+#define MAIN_THREAD_DISPATCHER_HAS_COROUTINES 1
+
+// Coroutine frames are taken from a fixed pool of blocks instead of the heap. A coroutine whose
+// frame does not fit a block, or that is started with every block in use, does not run and
+// its task is invalid. Frame sizes depend on the locals kept across co_await.
+#ifndef MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES
+#define MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES 4
+#endif
+
+#ifndef MAIN_THREAD_DISPATCHER_COROUTINE_FRAME_SIZE
+#define MAIN_THREAD_DISPATCHER_COROUTINE_FRAME_SIZE 256
+#endif
+
+class CoroutineFramePool
+{
+public:
+    static void *Allocate(size_t size) noexcept
+    {
+        if (size > MAIN_THREAD_DISPATCHER_COROUTINE_FRAME_SIZE || _freeHead() == _none)
+        {
+            _failedCount()++;
+            return nullptr;
+        }
+        uint8_t index = _freeHead();
+        _freeHead() = _blocks()[index].next;
+        _usedCount()++;
+        return _blocks()[index].data;
+    }
+
+    static void Free(void *frame) noexcept
+    {
+        Block *block = reinterpret_cast<Block *>(frame);
+        block->next = _freeHead();
+        _freeHead() = static_cast<uint8_t>(block - _blocks());
+        _usedCount()--;
+    }
+
+    // Frames currently held by running or suspended coroutines
+    static size_t GetUsedCount() { return _usedCount(); }
+
+    // Coroutines that could not start because no block was free or their frame was too large
+    static uint32_t GetFailedCount() { return _failedCount(); }
+
+private:
+    static_assert(MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES < 0xFF, "Frame blocks are indexed with 8 bits");
+
+    static constexpr uint8_t _none = 0xFF;
+
+    // The frame data comes first, so a frame pointer is also a block pointer
+    union Block
+    {
+        alignas(std::max_align_t) unsigned char data[MAIN_THREAD_DISPATCHER_COROUTINE_FRAME_SIZE];
+        uint8_t next;
+    };
+
+    static Block *_blocks()
+    {
+        static Block instance[MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES];
+        return instance;
+    }
+
+    static uint8_t &_freeHead()
+    {
+        static uint8_t instance = _buildFreeList();
+        return instance;
+    }
+
+    static uint8_t _buildFreeList()
+    {
+        for (uint8_t i = 0; i < MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES; i++)
+            _blocks()[i].next = i + 1 < MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES ? i + 1 : _none;
+        return MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES == 0 ? _none : 0;
+    }
+
+    static size_t &_usedCount()
+    {
+        static size_t instance = 0;
+        return instance;
+    }
+
+    static uint32_t &_failedCount()
+    {
+        static uint32_t instance = 0;
+        return instance;
+    }
+};
+
+// Fire-and-forget coroutine resumed from Dispatcher::Loop(). It runs synchronously until its
+// first suspension, then every co_await resumes it from the main loop:
+//
+//     MainThreadDispatcher::Task blink()
+//     {
+//         for (;;)
+//         {
+//             digitalWrite(LED_BUILTIN, HIGH);
+//             co_await MainThreadDispatcher::Task::Delay(500);
+//             digitalWrite(LED_BUILTIN, LOW);
+//             co_await MainThreadDispatcher::Task::Delay(500);
+//         }
+//     }
+//
+// Besides Delay() and WaitUntil(), a DispatcherFuture can be awaited directly. It yields an
+// optional that is empty when the future is invalid or rejected:
+//
+//     std::optional<float> reading = co_await MainThreadDispatcher::DispatchWithResult(readSensor);
+//     if (!reading)
+//         co_return;
+//
+// Awaiting a delay or poll the dispatcher cannot schedule (no free slot) resumes immediately.
+template <typename Dispatcher>
+class DispatcherTask
+{
+public:
+    struct promise_type
+    {
+        DispatcherTask get_return_object() { return DispatcherTask(true); }
+        static DispatcherTask get_return_object_on_allocation_failure() { return DispatcherTask(false); }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+
+        static void *operator new(size_t size) noexcept { return CoroutineFramePool::Allocate(size); }
+        static void operator delete(void *frame) noexcept { CoroutineFramePool::Free(frame); }
+
+        template <typename T>
+        auto await_transform(DispatcherFuture<T, Dispatcher> future) { return _FutureAwaiter<T>{std::move(future)}; }
+
+        template <typename Awaitable>
+        Awaitable &&await_transform(Awaitable &&awaitable) { return std::forward<Awaitable>(awaitable); }
+    };
+
+    // False when the coroutine could not get a frame and did not run
+    bool IsValid() const { return _valid; }
+
+    struct DelayAwaiter
+    {
+        unsigned long delayMs;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) const
+        {
+            return Dispatcher::Dispatch([handle]() { handle.resume(); }, delayMs).IsValid();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    // Resumes from Loop() after delayMs
+    static DelayAwaiter Delay(unsigned long delayMs) { return DelayAwaiter{delayMs}; }
+
+    template <typename Pred>
+    struct WaitUntilAwaiter
+    {
+        Pred pred;
+        unsigned long pollMs;
+
+        bool await_ready() { return pred(); }
+
+        bool await_suspend(std::coroutine_handle<> handle) { return _poll(this, handle); }
+
+        void await_resume() const noexcept { }
+
+        // The awaiter lives in the suspended frame, so polls can refer to it
+        static bool _poll(WaitUntilAwaiter *awaiter, std::coroutine_handle<> handle)
+        {
+            return Dispatcher::Dispatch([awaiter, handle]() {
+                if (awaiter->pred() || !_poll(awaiter, handle))
+                    handle.resume();
+            }, awaiter->pollMs).IsValid();
+        }
+    };
+
+    // Resumes from Loop() once pred() returns true, checking it every pollMs. Useful for
+    // completions that are polled rather than signalled, e.g. a client having data available.
+    template <typename Pred>
+    static WaitUntilAwaiter<std::decay_t<Pred>> WaitUntil(Pred &&pred, unsigned long pollMs = 0)
+    {
+        return WaitUntilAwaiter<std::decay_t<Pred>>{std::forward<Pred>(pred), pollMs};
+    }
+
+private:
+    template <typename T>
+    struct _FutureAwaiter
+    {
+        DispatcherFuture<T, Dispatcher> future;
+
+        bool await_ready() const noexcept { return !future.IsValid() || future.IsReady() || future.IsFailed(); }
+
+        // Waits on the state directly rather than through Then(), which would neither need a
+        // state for its own result nor resume on rejection. The coroutine resumes from Loop()
+        // once the value is set, or right away from the call that rejects the future or sets it
+        // while the dispatcher is full.
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            future._state->SetContinuation([handle]() { handle.resume(); });
+        }
+
+        std::optional<typename DispatcherFuture<T, Dispatcher>::Value> await_resume() const
+        {
+            if (!future.IsReady())
+                return std::nullopt;
+            return future.Get();
+        }
+    };
+
+    explicit DispatcherTask(bool valid) : _valid(valid) { }
+
+    bool _valid;
+};
+
+#endif
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Shared states available per result type, bounding the memory used by futures. A future that
+// cannot get a state is invalid, like a Dispatch() into a full fixed-capacity dispatcher; a step
+// further down a chain that cannot be scheduled rejects the futures depending on it instead.
+#ifndef MAIN_THREAD_DISPATCHER_FUTURE_POOL_SIZE
+#define MAIN_THREAD_DISPATCHER_FUTURE_POOL_SIZE 4
+#endif
+
+// Value held by futures of void
+struct FutureVoid
+{
+};
+
+template <typename T, typename Dispatcher>
+class DispatcherFuture;
+
+template <typename T>
+struct IsDispatcherFuture : std::false_type
+{
+};
+
+template <typename T, typename Dispatcher>
+struct IsDispatcherFuture<DispatcherFuture<T, Dispatcher>> : std::true_type
+{
+};
+
+// Result slot shared by a producer and its future. Lives in a fixed per-type pool and is
+// reference counted; only ever touched from the main loop, so the counts are not atomic.
+template <typename T, typename Dispatcher>
+class DispatcherFutureState
+{
+public:
+    using Value = std::conditional_t<std::is_void<T>::value, FutureVoid, T>;
+
+    class Ref
+    {
+    public:
+        Ref() = default;
+        explicit Ref(DispatcherFutureState *state) : _state(state) { }
+        Ref(const Ref &other) : _state(other._state) { _addRef(); }
+        Ref(Ref &&other) noexcept : _state(other._state) { other._state = nullptr; }
+        ~Ref() { _release(); }
+
+        Ref &operator=(Ref other) noexcept
+        {
+            std::swap(_state, other._state);
+            return *this;
+        }
+
+        DispatcherFutureState *operator->() const { return _state; }
+        DispatcherFutureState *Get() const { return _state; }
+        explicit operator bool() const { return _state != nullptr; }
+
+    private:
+        void _addRef()
+        {
+            if (_state != nullptr)
+                _state->_refs++;
+        }
+
+        void _release()
+        {
+            if (_state != nullptr && --_state->_refs == 0)
+                _state->_reset();
+            _state = nullptr;
+        }
+
+        DispatcherFutureState *_state = nullptr;
+    };
+
+    // Returns an empty Ref when the pool is exhausted
+    static Ref Allocate()
+    {
+        for (DispatcherFutureState &state : _pool())
+        {
+            if (state._refs == 0)
+            {
+                state._refs = 1;
+                return Ref(&state);
+            }
+        }
+        return Ref();
+    }
+
+    bool IsReady() const { return _value.has_value(); }
+    // The value will never come
+    bool IsFailed() const { return _failed; }
+    const Value &GetValue() const { return *_value; }
+
+    void SetValue(Value value)
+    {
+        if (_value.has_value() || _failed)
+            return;
+        _value.emplace(std::move(value));
+        if (_continuation)
+            _dispatchContinuation();
+    }
+
+    void Reject()
+    {
+        if (_value.has_value() || _failed)
+            return;
+        _failed = true;
+        if (_continuation)
+            _runContinuation();
+    }
+
+    // Only one continuation per state. It runs from Loop() once the value is set, or right away
+    // when the state is rejected or the dispatcher has no slot for it, seeing CanContinue() false
+    // so it only rejects what it feeds. Returns false in those two cases.
+    template <typename F>
+    bool SetContinuation(F &&func)
+    {
+        _continuation = typename Dispatcher::Callable(std::forward<F>(func));
+        if (_failed)
+        {
+            _runContinuation();
+            return false;
+        }
+        if (_value.has_value())
+            return _dispatchContinuation();
+        return true;
+    }
+
+    // Whether the running continuation gets the value
+    bool CanContinue() const { return _value.has_value() && !_continuationFailed; }
+
+private:
+    // The dispatched closure only carries a reference to this state, the continuation itself
+    // stays stored here. This keeps the closure one pointer wide and avoids reference cycles.
+    bool _dispatchContinuation()
+    {
+        _refs++;
+        if (Dispatcher::Dispatch([ref = Ref(this)]() { ref->_runContinuation(); }).IsValid())
+            return true;
+        _continuationFailed = true;
+        _runContinuation();
+        return false;
+    }
+
+    void _runContinuation()
+    {
+        typename Dispatcher::Callable continuation = std::move(_continuation);
+        _continuation = nullptr;
+        continuation();
+    }
+
+    void _reset()
+    {
+        _value.reset();
+        _continuation = nullptr;
+        _failed = false;
+        _continuationFailed = false;
+    }
+
+    static DispatcherFutureState (&_pool())[MAIN_THREAD_DISPATCHER_FUTURE_POOL_SIZE]
+    {
+        static DispatcherFutureState instance[MAIN_THREAD_DISPATCHER_FUTURE_POOL_SIZE];
+        return instance;
+    }
+
+    std::optional<Value> _value;
+    typename Dispatcher::Callable _continuation;
+    uint8_t _refs = 0;
+    bool _failed = false;
+    // The value is set but the continuation could not be dispatched
+    bool _continuationFailed = false;
+};
+
+// Result of a task running on a MainThreadDispatcher. Then() chains work that runs on the
+// dispatcher once the result is available, without blocking loop(). A continuation returning
+// another DispatcherFuture is flattened, so asynchronous steps can be chained too.
+template <typename T, typename Dispatcher>
+class DispatcherFuture
+{
+public:
+    using State = DispatcherFutureState<T, Dispatcher>;
+    using Value = typename State::Value;
+
+    DispatcherFuture() = default;
+    explicit DispatcherFuture(typename State::Ref state) : _state(std::move(state)) { }
+
+    // False when no state or dispatcher slot was available
+    bool IsValid() const { return static_cast<bool>(_state); }
+    bool IsReady() const { return _state && _state->IsReady(); }
+    // Rejected: a step before this one was rejected or could not be scheduled
+    bool IsFailed() const { return _state && _state->IsFailed(); }
+
+    // Only valid once IsReady()
+    const Value &Get() const { return _state->GetValue(); }
+
+    // func receives the value (nothing for futures of void) and runs on the dispatcher.
+    // Only one continuation can be attached to a future. The returned future is invalid when
+    // this one is or no state is left for it, and is rejected, without func running, when this
+    // one is rejected, the dispatcher has no slot for func, or func returns an invalid or
+    // rejected future.
+    template <typename F>
+    auto Then(F &&func)
+    {
+        using Result = decltype(_invoke(func, std::declval<const Value &>()));
+        using Next = std::conditional_t<IsDispatcherFuture<Result>::value, Result, DispatcherFuture<Result, Dispatcher>>;
+        if (!_state)
+            return Next();
+        auto next = Next::State::Allocate();
+        if (!next)
+            return Next();
+        State *source = _state.Get();
+        _state->SetContinuation([source, next, func = std::forward<F>(func)]() mutable {
+            if (!source->CanContinue())
+            {
+                next->Reject();
+                return;
+            }
+            if constexpr (IsDispatcherFuture<Result>::value)
+            {
+                Result inner = _invoke(func, source->GetValue());
+                if (!inner._state)
+                {
+                    next->Reject();
+                    return;
+                }
+                // Kept alive by whoever sets its value, like source
+                auto *innerSource = inner._state.Get();
+                innerSource->SetContinuation([innerSource, next]() {
+                    if (innerSource->CanContinue())
+                        next->SetValue(innerSource->GetValue());
+                    else
+                        next->Reject();
+                });
+            }
+            else if constexpr (std::is_void<Result>::value)
+            {
+                _invoke(func, source->GetValue());
+                next->SetValue(FutureVoid());
+            }
+            else
+                next->SetValue(_invoke(func, source->GetValue()));
+        });
+        return Next(next);
+    }
+
+private:
+    template <typename, typename>
+    friend class DispatcherFuture;
+    template <typename>
+    friend class DispatcherTask;
+
+    template <typename F>
+    static decltype(auto) _invoke(F &func, const Value &value)
+    {
+        if constexpr (std::is_void<T>::value)
+            return func();
+        else
+            return func(value);
+    }
+
+    typename State::Ref _state;
+};
+
+// Producer side for results that do not come from a dispatched task, e.g. an HTTP response
+// picked up by a polling loop. SetValue() must be called from the main loop.
+template <typename T, typename Dispatcher>
+class DispatcherPromise
+{
+public:
+    using State = DispatcherFutureState<T, Dispatcher>;
+
+    DispatcherPromise() : _state(State::Allocate()) { }
+
+    bool IsValid() const { return static_cast<bool>(_state); }
+    DispatcherFuture<T, Dispatcher> GetFuture() const { return DispatcherFuture<T, Dispatcher>(_state); }
+
+    void SetValue(typename State::Value value)
+    {
+        if (_state)
+            _state->SetValue(std::move(value));
+    }
+
+    // Fails the future and everything chained to it
+    void Reject()
+    {
+        if (_state)
+            _state->Reject();
+    }
+
+private:
+    typename State::Ref _state;
+};
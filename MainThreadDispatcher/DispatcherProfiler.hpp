@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Linear sub-buckets per power of two in LogLinearHistogram, as a number of bits: 2 keeps the
+// relative bucket error under 25% with 124 buckets covering 0 to 2^32 us
+#ifndef MAIN_THREAD_DISPATCHER_HISTOGRAM_SUB_BITS
+#define MAIN_THREAD_DISPATCHER_HISTOGRAM_SUB_BITS 2
+#endif
+
+// Distinct names SetTaskName() can profile separately
+#ifndef MAIN_THREAD_DISPATCHER_PROFILE_NAMES
+#define MAIN_THREAD_DISPATCHER_PROFILE_NAMES 8
+#endif
+
+// Fixed-size histogram of microsecond durations. Values below 2^SubBits get their own bucket,
+// every power of two above is split into 2^SubBits linear buckets (HdrHistogram style).
+class LogLinearHistogram
+{
+public:
+    static constexpr uint8_t SubBits = MAIN_THREAD_DISPATCHER_HISTOGRAM_SUB_BITS;
+    static constexpr size_t BucketCount = (32 - SubBits + 1) << SubBits;
+
+    void Record(uint64_t value)
+    {
+        uint32_t clamped = value > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(value);
+        _buckets[_indexOf(clamped)]++;
+        if (_count == 0 || clamped < _min)
+            _min = clamped;
+        if (clamped > _max)
+            _max = clamped;
+        _count++;
+        _sum += clamped;
+    }
+
+    void Reset() { *this = LogLinearHistogram(); }
+
+    uint32_t GetCount() const { return _count; }
+    uint32_t GetMin() const { return _min; }
+    uint32_t GetMax() const { return _max; }
+    uint32_t GetMean() const { return _count == 0 ? 0 : static_cast<uint32_t>(_sum / _count); }
+
+    // Upper bound of the bucket holding the given percentile (0-100), capped at the maximum seen
+    uint32_t GetPercentile(uint8_t percentile) const
+    {
+        if (_count == 0)
+            return 0;
+        uint64_t rank = (static_cast<uint64_t>(_count) * percentile + 99) / 100;
+        if (rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; i++)
+        {
+            seen += _buckets[i];
+            if (seen >= rank)
+                return _upperBound(i) < _max ? _upperBound(i) : _max;
+        }
+        return _max;
+    }
+
+    // {"count":..,"min":..,"max":..,"mean":..,"p50":..,"p90":..,"p99":..,"buckets":[[lowerBound,count],...]}
+    // listing non-empty buckets only
+    template <typename TStream>
+    void WriteJson(TStream &out) const
+    {
+        out.print("{\"count\":");
+        out.print(_count);
+        out.print(",\"min\":");
+        out.print(_min);
+        out.print(",\"max\":");
+        out.print(_max);
+        out.print(",\"mean\":");
+        out.print(GetMean());
+        out.print(",\"p50\":");
+        out.print(GetPercentile(50));
+        out.print(",\"p90\":");
+        out.print(GetPercentile(90));
+        out.print(",\"p99\":");
+        out.print(GetPercentile(99));
+        out.print(",\"buckets\":[");
+        bool first = true;
+        for (size_t i = 0; i < BucketCount; i++)
+        {
+            if (_buckets[i] == 0)
+                continue;
+            out.print(first ? "[" : ",[");
+            out.print(_lowerBound(i));
+            out.print(",");
+            out.print(_buckets[i]);
+            out.print("]");
+            first = false;
+        }
+        out.print("]}");
+    }
+
+private:
+    static size_t _indexOf(uint32_t value)
+    {
+        if (value < (1U << SubBits))
+            return value;
+        uint8_t msb = 31 - __builtin_clz(value);
+        uint8_t shift = msb - SubBits;
+        return ((shift + 1) << SubBits) + ((value >> shift) - (1U << SubBits));
+    }
+
+    static uint32_t _lowerBound(size_t index)
+    {
+        if (index < (1U << SubBits))
+            return static_cast<uint32_t>(index);
+        uint8_t shift = static_cast<uint8_t>((index >> SubBits) - 1);
+        return static_cast<uint32_t>((index & ((1U << SubBits) - 1)) + (1U << SubBits)) << shift;
+    }
+
+    static uint32_t _upperBound(size_t index)
+    {
+        return index + 1 < BucketCount ? _lowerBound(index + 1) - 1 : UINT32_MAX;
+    }
+
+    uint32_t _buckets[BucketCount] = {};
+    uint32_t _count = 0;
+    uint32_t _min = 0;
+    uint32_t _max = 0;
+    uint64_t _sum = 0;
+};
+
+// Lateness (run time minus due time) and execution time of every task run by a dispatcher,
+// plus per-name totals for tasks tagged with SetTaskName(). Names are not copied and must
+// outlive the profile, string literals being the usual case.
+class DispatcherProfiler
+{
+public:
+    static constexpr uint8_t None = 0xFF;
+
+    // Index of the profile for name, None when the name table is full
+    uint8_t Register(const char *name)
+    {
+        for (uint8_t i = 0; i < _nameCount; i++)
+        {
+            if (strcmp(_names[i].name, name) == 0)
+                return i;
+        }
+        if (_nameCount == MAIN_THREAD_DISPATCHER_PROFILE_NAMES)
+            return None;
+        _names[_nameCount] = NamedProfile();
+        _names[_nameCount].name = name;
+        return _nameCount++;
+    }
+
+    void Record(uint8_t profile, uint64_t latenessUs, uint64_t execUs)
+    {
+        _lateness.Record(latenessUs);
+        _exec.Record(execUs);
+        if (profile >= _nameCount)
+            return;
+        NamedProfile &named = _names[profile];
+        named.count++;
+        named.totalUs += execUs;
+        if (execUs > named.maxUs)
+            named.maxUs = execUs > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(execUs);
+        if (latenessUs > named.maxLatenessUs)
+            named.maxLatenessUs = latenessUs > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(latenessUs);
+    }
+
+    // Clears the measurements, names stay registered
+    void Reset()
+    {
+        _lateness.Reset();
+        _exec.Reset();
+        for (uint8_t i = 0; i < _nameCount; i++)
+        {
+            const char *name = _names[i].name;
+            _names[i] = NamedProfile();
+            _names[i].name = name;
+        }
+    }
+
+    const LogLinearHistogram &GetLateness() const { return _lateness; }
+    const LogLinearHistogram &GetExecution() const { return _exec; }
+
+    // {"latenessUs":{histogram},"execUs":{histogram},"tasks":[{"name":..,"count":..,"totalUs":..,"maxUs":..,"maxLatenessUs":..}]}
+    template <typename TStream>
+    void WriteJson(TStream &out) const
+    {
+        out.print("{\"latenessUs\":");
+        _lateness.WriteJson(out);
+        out.print(",\"execUs\":");
+        _exec.WriteJson(out);
+        out.print(",\"tasks\":[");
+        for (uint8_t i = 0; i < _nameCount; i++)
+        {
+            const NamedProfile &named = _names[i];
+            out.print(i == 0 ? "{\"name\":\"" : ",{\"name\":\"");
+            _printEscaped(out, named.name);
+            out.print("\",\"count\":");
+            out.print(named.count);
+            out.print(",\"totalUs\":");
+            out.print(static_cast<unsigned long long>(named.totalUs));
+            out.print(",\"maxUs\":");
+            out.print(named.maxUs);
+            out.print(",\"maxLatenessUs\":");
+            out.print(named.maxLatenessUs);
+            out.print("}");
+        }
+        out.print("]}");
+    }
+
+private:
+    struct NamedProfile
+    {
+        const char *name = nullptr;
+        uint32_t count = 0;
+        uint64_t totalUs = 0;
+        uint32_t maxUs = 0;
+        uint32_t maxLatenessUs = 0;
+    };
+
+    template <typename TStream>
+    static void _printEscaped(TStream &out, const char *text)
+    {
+        for (; *text != '\0'; text++)
+        {
+            if (*text == '"' || *text == '\\')
+                out.print('\\');
+            out.print(*text);
+        }
+    }
+
+    LogLinearHistogram _lateness;
+    LogLinearHistogram _exec;
+    NamedProfile _names[MAIN_THREAD_DISPATCHER_PROFILE_NAMES];
+    uint8_t _nameCount = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Vector-like container over inline storage, used by the fixed-capacity dispatcher.
+// Callers are expected to check capacity() before pushing.
+template <typename T, size_t N>
+class FixedVector
+{
+public:
+    FixedVector() = default;
+    FixedVector(const FixedVector &) = delete;
+    FixedVector &operator=(const FixedVector &) = delete;
+    ~FixedVector() { clear(); }
+
+    T *begin() { return _data(); }
+    T *end() { return _data() + _size; }
+    const T *begin() const { return _data(); }
+    const T *end() const { return _data() + _size; }
+
+    T &operator[](size_t index) { return _data()[index]; }
+    const T &operator[](size_t index) const { return _data()[index]; }
+    T &front() { return _data()[0]; }
+    const T &front() const { return _data()[0]; }
+    T &back() { return _data()[_size - 1]; }
+    const T &back() const { return _data()[_size - 1]; }
+
+    size_t size() const { return _size; }
+    constexpr size_t capacity() const { return N; }
+    bool empty() const { return _size == 0; }
+
+    void push_back(const T &value) { new (_data() + _size++) T(value); }
+    void push_back(T &&value) { new (_data() + _size++) T(std::move(value)); }
+
+    template <typename... Args>
+    T &emplace_back(Args &&...args) { return *new (_data() + _size++) T(std::forward<Args>(args)...); }
+
+    void pop_back() { _data()[--_size].~T(); }
+
+    T *erase(T *first, T *last)
+    {
+        T *out = first;
+        for (T *it = last; it != end(); ++it)
+            *out++ = std::move(*it);
+        while (end() != out)
+            pop_back();
+        return first;
+    }
+
+    void clear()
+    {
+        while (_size > 0)
+            pop_back();
+    }
+
+private:
+    T *_data() { return reinterpret_cast<T *>(_storage); }
+    const T *_data() const { return reinterpret_cast<const T *>(_storage); }
+
+    alignas(T) unsigned char _storage[sizeof(T) * N];
+    size_t _size = 0;
+};
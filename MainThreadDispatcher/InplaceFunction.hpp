@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifndef MTD_ISR_ATTR
+#if defined(IRAM_ATTR)
+#define MTD_ISR_ATTR IRAM_ATTR
+#else
+#define MTD_ISR_ATTR
+#endif
+#endif
+
+// void() callable stored entirely inside the object. Callables larger than Size are
+// rejected at compile time instead of falling back to the heap. Copying is supported so
+// it can be wrapped in a std::function; copying a move-only callable yields an empty function.
+template <size_t Size>
+class InplaceFunction
+{
+public:
+    InplaceFunction() = default;
+    InplaceFunction(std::nullptr_t) { }
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InplaceFunction>::value && !std::is_same<std::decay_t<F>, std::nullptr_t>::value>>
+    InplaceFunction(F &&func)
+    {
+        using Functor = std::decay_t<F>;
+        static_assert(sizeof(Functor) <= Size, "Callable does not fit in InplaceFunction, increase its Size");
+        static_assert(alignof(Functor) <= alignof(std::max_align_t), "Callable is over-aligned for InplaceFunction");
+        if (_isNull(func))
+            return;
+        new (_storage) Functor(std::forward<F>(func));
+        _ops = &_opsFor<Functor>::ops;
+    }
+
+    InplaceFunction(InplaceFunction &&other) noexcept { _moveFrom(other); }
+
+    InplaceFunction &operator=(InplaceFunction &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            _moveFrom(other);
+        }
+        return *this;
+    }
+
+    InplaceFunction &operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+
+    InplaceFunction(const InplaceFunction &other) { _copyFrom(other); }
+
+    InplaceFunction &operator=(const InplaceFunction &other)
+    {
+        if (this != &other)
+        {
+            reset();
+            _copyFrom(other);
+        }
+        return *this;
+    }
+
+    ~InplaceFunction() { reset(); }
+
+    void operator()() { _ops->invoke(_storage); }
+
+    explicit operator bool() const { return _ops != nullptr; }
+
+    void reset()
+    {
+        if (_ops == nullptr)
+            return;
+        _ops->destroy(_storage);
+        _ops = nullptr;
+    }
+
+    // Store, move and drop a trivially copyable callable with plain memory copies, never going
+    // through the ops table, which lives in flash. For interrupt handlers that may run while the
+    // flash cache is disabled. Only for functions holding such a callable, or empty ones.
+    template <typename F>
+    MTD_ISR_ATTR void EmplaceTrivial(const F &func)
+    {
+        static_assert(std::is_trivially_copyable<F>::value, "EmplaceTrivial() needs a trivially copyable callable");
+        static_assert(sizeof(F) <= Size, "Callable does not fit in InplaceFunction, increase its Size");
+        memcpy(_storage, &func, sizeof(F));
+        _ops = &_opsFor<F>::ops;
+    }
+
+    MTD_ISR_ATTR void MoveTrivialFrom(InplaceFunction &other)
+    {
+        memcpy(_storage, other._storage, Size);
+        _ops = other._ops;
+        other._ops = nullptr;
+    }
+
+    MTD_ISR_ATTR void ReleaseTrivial() { _ops = nullptr; }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*move)(void *from, void *to);
+        void (*copy)(const void *from, void *to);
+        void (*destroy)(void *storage);
+    };
+
+    template <typename Functor>
+    struct _opsFor
+    {
+        static void invoke(void *storage) { (*static_cast<Functor *>(storage))(); }
+        static void move(void *from, void *to)
+        {
+            new (to) Functor(std::move(*static_cast<Functor *>(from)));
+            static_cast<Functor *>(from)->~Functor();
+        }
+        static void copy(const void *from, void *to) { new (to) Functor(*static_cast<const Functor *>(from)); }
+        static void destroy(void *storage) { static_cast<Functor *>(storage)->~Functor(); }
+        static constexpr void (*copyIfPossible())(const void *, void *)
+        {
+            if constexpr (std::is_copy_constructible<Functor>::value)
+                return copy;
+            else
+                return nullptr;
+        }
+        static constexpr Ops ops = {invoke, move, copyIfPossible(), destroy};
+    };
+
+    template <typename F>
+    static bool _isNull(const F &func)
+    {
+        if constexpr (std::is_pointer<F>::value || std::is_member_pointer<F>::value)
+            return func == nullptr;
+        else
+            return false;
+    }
+
+    void _moveFrom(InplaceFunction &other)
+    {
+        if (other._ops == nullptr)
+            return;
+        other._ops->move(other._storage, _storage);
+        _ops = other._ops;
+        other._ops = nullptr;
+    }
+
+    void _copyFrom(const InplaceFunction &other)
+    {
+        if (other._ops == nullptr || other._ops->copy == nullptr)
+            return;
+        other._ops->copy(other._storage, _storage);
+        _ops = other._ops;
+    }
+
+    alignas(std::max_align_t) unsigned char _storage[Size];
+    const Ops *_ops = nullptr;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// uint32_t key -> uint16_t slot index lookup, as used for keyed dispatches
+
+class DynamicKeyIndex
+{
+public:
+    bool Find(uint32_t key, uint16_t &value) const
+    {
+        auto it = _map.find(key);
+        if (it == _map.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+
+    void Insert(uint32_t key, uint16_t value) { _map[key] = value; }
+    void Erase(uint32_t key) { _map.erase(key); }
+
+private:
+    std::unordered_map<uint32_t, uint16_t> _map;
+};
+
+// Open addressing with linear probing over inline storage. The table is sized to at least
+// twice Capacity, so it is never more than half full and probes stay short.
+template <size_t Capacity>
+class FixedKeyIndex
+{
+public:
+    bool Find(uint32_t key, uint16_t &value) const
+    {
+        for (size_t i = _hash(key);; i = (i + 1) & _mask)
+        {
+            if (!_entries[i].used)
+                return false;
+            if (_entries[i].key == key)
+            {
+                value = _entries[i].value;
+                return true;
+            }
+        }
+    }
+
+    void Insert(uint32_t key, uint16_t value)
+    {
+        size_t i = _hash(key);
+        while (_entries[i].used && _entries[i].key != key)
+            i = (i + 1) & _mask;
+        _entries[i].key = key;
+        _entries[i].value = value;
+        _entries[i].used = true;
+    }
+
+    // Backward-shift deletion, so no tombstones build up in the table
+    void Erase(uint32_t key)
+    {
+        size_t i = _hash(key);
+        for (;; i = (i + 1) & _mask)
+        {
+            if (!_entries[i].used)
+                return;
+            if (_entries[i].key == key)
+                break;
+        }
+        _entries[i].used = false;
+        for (size_t j = (i + 1) & _mask; _entries[j].used; j = (j + 1) & _mask)
+        {
+            size_t home = _hash(_entries[j].key);
+            // Move the entry back if its home position is not cyclically within (i, j]
+            bool reachable = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+            if (reachable)
+                continue;
+            _entries[i] = _entries[j];
+            _entries[j].used = false;
+            i = j;
+        }
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t key = 0;
+        uint16_t value = 0;
+        bool used = false;
+    };
+
+    static constexpr size_t _tableSize()
+    {
+        size_t size = 2;
+        while (size < Capacity * 2)
+            size *= 2;
+        return size;
+    }
+
+    static constexpr size_t _mask = _tableSize() - 1;
+
+    static size_t _hash(uint32_t key)
+    {
+        key ^= key >> 16;
+        key *= 0x45d9f3bU;
+        key ^= key >> 16;
+        return key & _mask;
+    }
+
+    Entry _entries[_tableSize()];
+};
@@ -1,60 +1,1123 @@
 #pragma once
 
+#include <algorithm>
+#include <climits>
 #include <functional>
+#include <type_traits>
 #include <vector>
+#include "BoundedMpmcQueue.hpp"
+#include "DispatcherCoroutine.hpp"
+#include "DispatcherFuture.hpp"
+#include "FixedVector.hpp"
+#include "InplaceFunction.hpp"
+#include "KeyIndex.hpp"
+#include "MonotonicClock.hpp"
+#include "TimerHeap.hpp"
+#include "TimingWheel.hpp"
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
 
-struct DelayedTask
+// Token-bucket lanes available to DispatchRateLimited()
+#ifndef MAIN_THREAD_DISPATCHER_RATE_LANES
+#define MAIN_THREAD_DISPATCHER_RATE_LANES 2
+#endif
+
+// Called between tasks to let the SDK service WiFi and the watchdog. Host simulations can define
+// it as nothing, or as a hook of their own.
+#ifndef MAIN_THREAD_DISPATCHER_YIELD
+#define MAIN_THREAD_DISPATCHER_YIELD() yield()
+#endif
+
+// Define as 1 to record task lateness and execution time histograms, see DumpProfile().
+// Compiled out entirely when 0.
+#ifndef MAIN_THREAD_DISPATCHER_PROFILING
+#define MAIN_THREAD_DISPATCHER_PROFILING 0
+#endif
+
+#if MAIN_THREAD_DISPATCHER_PROFILING
+#include "DispatcherProfiler.hpp"
+#endif
+
+// Define before including to switch MainThreadDispatcher to the fixed-capacity mode:
+// at most MAIN_THREAD_DISPATCHER_CAPACITY pending tasks, callables stored in place,
+// no heap allocation after startup. 0 keeps the growable std::function based mode.
+#ifndef MAIN_THREAD_DISPATCHER_CAPACITY
+#define MAIN_THREAD_DISPATCHER_CAPACITY 0
+#endif
+
+// Maximum size in bytes of a callable (lambda captures included) in fixed-capacity mode
+#ifndef MAIN_THREAD_DISPATCHER_CALLABLE_SIZE
+#define MAIN_THREAD_DISPATCHER_CALLABLE_SIZE 24
+#endif
+
+// Slots in the lock-free ring used by DispatchFromISR(), must be a power of two
+#ifndef MAIN_THREAD_DISPATCHER_INGRESS_CAPACITY
+#define MAIN_THREAD_DISPATCHER_INGRESS_CAPACITY 16
+#endif
+
+// Define as 1 to back the dispatcher with a hierarchical timing wheel instead of a binary heap:
+// O(1) insert and expiry for very large timer counts, at the cost of a fixed bucket table
+#ifndef MAIN_THREAD_DISPATCHER_USE_TIMING_WHEEL
+#define MAIN_THREAD_DISPATCHER_USE_TIMING_WHEEL 0
+#endif
+
+// A due task that has waited this long runs ahead of higher priority lanes with later deadlines
+#ifndef MAIN_THREAD_DISPATCHER_AGING_MS
+#define MAIN_THREAD_DISPATCHER_AGING_MS 100
+#endif
+
+// Longest single sleep taken by LoopAndSleep() between checks for ISR dispatches on targets
+// where the sleep cannot be interrupted early (everything but ESP32)
+#ifndef MAIN_THREAD_DISPATCHER_SLEEP_SLICE_MS
+#define MAIN_THREAD_DISPATCHER_SLEEP_SLICE_MS 10
+#endif
+
+// Identifies a dispatched task. The generation is bumped every time a slot is
+// released, so a handle to a task that already ran or was cancelled never
+// matches a newer task reusing the same slot.
+struct TaskHandle
+{
+    uint16_t index = 0;
+    uint16_t generation = 0;
+
+    bool IsValid() const { return generation != 0; }
+};
+
+enum class RepeatMode : uint8_t
 {
-    std::function<void()> func;
-    long delayMs;
-    unsigned long scheduledTime;
+    // Each deadline is the previous deadline plus one period, so runs do not drift.
+    // Periods missed while the loop was busy are skipped instead of run back-to-back.
+    FixedRate,
+    // The next run is scheduled one period after the previous run returned
+    FixedDelay
 };
 
-class MainThreadDispatcher
+// Due tasks run lane by lane, High first
+enum class TaskPriority : uint8_t
 {
+    // e.g. network I/O continuations
+    High,
+    Normal,
+    // e.g. bulk housekeeping
+    Low
+};
+
+// Queue metrics of a rate lane, see GetRateLaneStats()
+struct RateLaneStats
+{
+    // Tasks waiting for a token
+    uint16_t depth = 0;
+    // Highest depth seen
+    uint16_t highWater = 0;
+    // Dispatches refused because the lane was full
+    uint32_t dropped = 0;
+    // Tasks handed over to the scheduler
+    uint32_t released = 0;
+};
+
+// What DispatchCoalesced() does when a task with the same key is already pending
+enum class CoalescePolicy : uint8_t
+{
+    // Restart the delay and keep the newest callable: runs once calls stop for delayMs (trailing debounce)
+    Debounce,
+    // Run the first call on the next Loop(), then hold the key for delayMs after it ran and drop
+    // the calls made in the meantime (leading edge throttle)
+    ThrottleLeading,
+    // Keep the pending deadline but run the newest callable: runs delayMs after the first call of
+    // a burst, so at most once per delayMs (trailing edge throttle)
+    ThrottleTrailing
+};
+
+template <size_t Capacity = 0, size_t CallableSize = MAIN_THREAD_DISPATCHER_CALLABLE_SIZE, bool UseTimingWheel = MAIN_THREAD_DISPATCHER_USE_TIMING_WHEEL>
+class BasicMainThreadDispatcher
+{
+    static_assert(Capacity <= 0xFFFF, "Task slots are indexed with 16 bits");
+
 public:
-    static void Loop()
+    using Callable = std::conditional_t<Capacity == 0, std::function<void()>, InplaceFunction<CallableSize>>;
+
+    template <typename T>
+    using Future = DispatcherFuture<T, BasicMainThreadDispatcher>;
+    template <typename T>
+    using Promise = DispatcherPromise<T, BasicMainThreadDispatcher>;
+#ifdef MAIN_THREAD_DISPATCHER_HAS_COROUTINES
+    using Task = DispatcherTask<BasicMainThreadDispatcher>;
+#endif
+
+    // Tasks bound to a group are cancelled together by CancelGroup() or when the group is
+    // destroyed, e.g. every timer tied to a chat session. The group only stores the head of an
+    // intrusive list threaded through the task slots, so it costs nothing per task.
+    class TaskGroup
     {
-        if (_tasks().empty())
-            return;
-        std::vector<DelayedTask> currentTasks;
-        currentTasks.insert(currentTasks.end(), _tasks().begin(), _tasks().end());
-        unsigned long currentTime = millis();
-        for (auto it = currentTasks.begin(); it != currentTasks.end();)
+    public:
+        TaskGroup() = default;
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+        // A group with static storage duration can outlive the dispatcher's slots at exit, its
+        // tasks are then gone already
+        ~TaskGroup()
         {
-            if (currentTime - it->scheduledTime < it->delayMs)
+            if (!_stateDestroyed)
+                CancelGroup(*this);
+        }
+
+        // Pending tasks in the group
+        size_t GetCount() const { return _count; }
+        bool IsEmpty() const { return _count == 0; }
+
+    private:
+        friend class BasicMainThreadDispatcher;
+
+        uint16_t _head = _noSlot;
+        uint16_t _count = 0;
+    };
+
+    // Runs due tasks, higher priority lanes first and in deadline order within a lane. With a
+    // non-zero budgetUs, stops once that much time has been spent (at least one task always runs)
+    // and leaves the rest for the next call. Returns the backlog: tasks already due but not run yet.
+    static size_t Loop(unsigned long budgetUs = 0)
+    {
+        _drainIngress();
+        _releaseRateLanes();
+        _backlog() = 0;
+        if (_timerCount() == 0)
+            return 0;
+        uint64_t currentTime = _now();
+        uint64_t startTime = currentTime;
+        for (uint8_t lane = 0; lane < _laneCount; lane++)
+            _timers(lane).Advance(currentTime);
+        // Tasks dispatched from inside a callback wait for the next Loop()
+        uint32_t endSequence = _nextSequence();
+        for (;;)
+        {
+            int lane = _selectLane(currentTime, endSequence);
+            if (lane < 0)
+                break;
+            auto &timers = _timers(lane);
+            TimerEntry entry = *timers.Peek();
+            timers.Pop();
+            DelayedTask &task = _tasks()[entry.index];
+            if (!_isLive(entry))
+            {
+                // Tombstone left behind by Cancel()
+                _staleCount()--;
+                continue;
+            }
+            if (task.holding)
+            {
+                // End of a leading throttle window, nothing to run
+                _releaseSlot(entry.index);
+                continue;
+            }
+            if (!task.repeating)
             {
-                ++it;
+                Callable func = std::move(task.func);
+                uint8_t profile = _profileOf(task);
+                if (task.holdUs != 0)
+                {
+                    // Leading throttle: the slot stays taken, callable-less, until the window ends
+                    task.func = nullptr;
+                    task.holding = true;
+                    _schedule(entry.index, currentTime + task.holdUs);
+                }
+                else
+                    _releaseSlot(entry.index);
+                _run(func, entry.dueTime, profile);
+                MAIN_THREAD_DISPATCHER_YIELD();
+                if (_budgetExhausted(startTime, budgetUs))
+                    break;
                 continue;
             }
-            it->func();
-            yield();
-            // remove it from original tasks list
-            auto originalIt = std::find_if(_tasks().begin(), _tasks().end(), [it](const DelayedTask &task) { return task.scheduledTime == it->scheduledTime && task.delayMs == it->delayMs; });
-            if (originalIt != _tasks().end())
-                _tasks().erase(originalIt);
-            it = currentTasks.erase(it);
+            // The closure is moved out for the call since the callback may dispatch and grow the
+            // slot storage, then moved back into the same slot unless the task cancelled itself
+            uint16_t generation = task.generation;
+            Callable func = std::move(task.func);
+            task.running = true;
+            _run(func, entry.dueTime, _profileOf(task));
+            DelayedTask &current = _tasks()[entry.index];
+            if (current.pending && current.generation == generation)
+            {
+                current.running = false;
+                current.func = std::move(func);
+                _schedule(entry.index, _nextDueTime(current, entry.dueTime, _now()));
+            }
+            MAIN_THREAD_DISPATCHER_YIELD();
+            if (_budgetExhausted(startTime, budgetUs))
+                break;
+        }
+        for (uint8_t lane = 0; lane < _laneCount; lane++)
+            _backlog() += _timers(lane).CountDue(currentTime, _isLive);
+        return _backlog();
+    }
+
+    // Backlog reported by the last Loop(), lets the main loop detect overload
+    static size_t GetBacklog() { return _backlog(); }
+
+    // Returns an invalid handle if the fixed-capacity pool is full. A negative delay runs the task
+    // on the next Loop(), like a zero one.
+    template <typename F>
+    static TaskHandle Dispatch(F &&func, long delayMs = 0, TaskPriority priority = TaskPriority::Normal)
+    {
+        return _add(std::forward<F>(func), _dueIn(delayMs), false, 0, RepeatMode::FixedRate, priority);
+    }
+
+    // Dispatch() with a delay in microseconds. How close to the deadline the task runs still
+    // depends on how often Loop() is called (and on the tick with the timing wheel).
+    template <typename F>
+    static TaskHandle DispatchMicros(F &&func, uint64_t delayUs, TaskPriority priority = TaskPriority::Normal)
+    {
+        return _add(std::forward<F>(func), _now() + delayUs, false, 0, RepeatMode::FixedRate, priority);
+    }
+
+    // Runs func every periodMs until cancelled, reusing the same slot and closure for every run.
+    // The first run happens one period from now.
+    template <typename F>
+    static TaskHandle DispatchRepeating(F &&func, unsigned long periodMs, RepeatMode mode = RepeatMode::FixedRate, TaskPriority priority = TaskPriority::Normal)
+    {
+        uint64_t periodUs = static_cast<uint64_t>(periodMs) * 1000;
+        return _add(std::forward<F>(func), _now() + periodUs, true, periodUs, mode, priority);
+    }
+
+    // Coalesces dispatches sharing a key into a single pending task, e.g. many "flush state"
+    // requests turning into one. The key lookup is a hash index, not a scan of the queue.
+    // Returns the handle of the pending task for that key; under ThrottleLeading the key stays
+    // pending during the window after the run. Use one policy per key.
+    template <typename F>
+    static TaskHandle DispatchCoalesced(uint32_t key, F &&func, long delayMs = 0, CoalescePolicy policy = CoalescePolicy::Debounce, TaskPriority priority = TaskPriority::Normal)
+    {
+        uint16_t index;
+        if (!_keys().Find(key, index))
+        {
+            bool leading = policy == CoalescePolicy::ThrottleLeading;
+            TaskHandle handle = _add(std::forward<F>(func), leading ? _now() : _dueIn(delayMs), false, 0, RepeatMode::FixedRate, priority);
+            if (handle.IsValid())
+            {
+                DelayedTask &task = _tasks()[handle.index];
+                task.keyed = true;
+                task.key = key;
+                if (leading && delayMs > 0)
+                    task.holdUs = static_cast<uint64_t>(delayMs) * 1000;
+                if (Capacity == 0)
+                    _allocationCount()++;
+                _keys().Insert(key, handle.index);
+            }
+            return handle;
+        }
+        DelayedTask &task = _tasks()[index];
+        if (policy != CoalescePolicy::ThrottleLeading)
+        {
+            if (Capacity == 0 && _mayAllocate<std::decay_t<F>>())
+                _allocationCount()++;
+            task.func = Callable(std::forward<F>(func));
+            task.holding = false;
+        }
+        if (policy == CoalescePolicy::Debounce)
+        {
+            // The previous timer entry becomes a tombstone
+            _staleCount()++;
+            _schedule(index, _dueIn(delayMs));
+        }
+        TaskHandle handle;
+        handle.index = index;
+        handle.generation = task.generation;
+        return handle;
+    }
+
+    static TaskHandle Dispatch_Ptr(void (*func)(), long delayMs = 0, TaskPriority priority = TaskPriority::Normal)
+    {
+        return Dispatch(func, delayMs, priority);
+    }
+
+    // Dispatch() binding the task to group
+    template <typename F>
+    static TaskHandle Dispatch(TaskGroup &group, F &&func, long delayMs = 0, TaskPriority priority = TaskPriority::Normal)
+    {
+        TaskHandle handle = Dispatch(std::forward<F>(func), delayMs, priority);
+        AddToGroup(handle, group);
+        return handle;
+    }
+
+    // Binds a pending task (of any kind: repeating, coalesced...) to group, moving it out of
+    // the group it was in. O(1). The task leaves the group when it runs for the last time or
+    // is cancelled.
+    static bool AddToGroup(TaskHandle handle, TaskGroup &group)
+    {
+        if (!IsPending(handle))
+            return false;
+        _unlinkFromGroup(handle.index);
+        DelayedTask &task = _tasks()[handle.index];
+        task.group = &group;
+        task.groupPrev = _noSlot;
+        task.groupNext = group._head;
+        if (group._head != _noSlot)
+            _tasks()[group._head].groupPrev = handle.index;
+        group._head = handle.index;
+        group._count++;
+        return true;
+    }
+
+    // Cancels every task in group, in time proportional to the group size.
+    // Returns the number of tasks cancelled.
+    static size_t CancelGroup(TaskGroup &group)
+    {
+        size_t cancelled = 0;
+        while (group._head != _noSlot)
+        {
+            uint16_t index = group._head;
+            TaskHandle handle;
+            handle.index = index;
+            handle.generation = _tasks()[index].generation;
+            if (Cancel(handle))
+                cancelled++;
+            else
+                _unlinkFromGroup(index);
+        }
+        return cancelled;
+    }
+
+    // Runs func on the main loop and returns a future for its result, e.g.
+    // DispatchWithResult(readSensor).Then(buildMessage).Then(send).
+    // The future is invalid when the state pool or the dispatcher is full.
+    template <typename F>
+    static Future<std::invoke_result_t<std::decay_t<F> &>> DispatchWithResult(F &&func, long delayMs = 0, TaskPriority priority = TaskPriority::Normal)
+    {
+        using Result = std::invoke_result_t<std::decay_t<F> &>;
+        auto state = Future<Result>::State::Allocate();
+        if (!state)
+            return Future<Result>();
+        TaskHandle handle = Dispatch([state, func = std::forward<F>(func)]() mutable {
+            if constexpr (std::is_void<Result>::value)
+            {
+                func();
+                state->SetValue(FutureVoid());
+            }
+            else
+                state->SetValue(func());
+        }, delayMs, priority);
+        if (!handle.IsValid())
+            return Future<Result>();
+        return Future<Result>(state);
+    }
+
+    // Safe to call from interrupt handlers, other FreeRTOS tasks and the other core. The task
+    // goes through a lock-free ring and is moved into the timer heap by the next Loop(), so no
+    // handle is returned. The callable is always stored in place (up to CallableSize bytes).
+    // Returns false when the ring is full.
+    // Only trivially copyable callables (function pointers, lambdas capturing plain values) are
+    // copied without running code from flash, so only those may be dispatched from an ISR that
+    // can fire while the flash cache is disabled (flash writes, OTA). Any other callable is
+    // constructed and moved by code in flash and crashes in that situation.
+    template <typename F>
+    static MTD_ISR_ATTR bool DispatchFromISR(F &&func, unsigned long delayMs = 0, TaskPriority priority = TaskPriority::Normal)
+    {
+        IngressTask task;
+        constexpr bool trivial = std::is_trivially_copyable<std::decay_t<F>>::value;
+        if constexpr (trivial)
+            task.func.EmplaceTrivial(static_cast<std::decay_t<F>>(func));
+        else
+            task.func = IngressCallable(std::forward<F>(func));
+        task.trivial = trivial;
+        task.dueTime = MonotonicClock::Micros() + static_cast<uint64_t>(delayMs) * 1000;
+        task.priority = priority;
+        if (_ingress.TryPush(std::move(task)))
+        {
+            _wakeSleeper();
+            return true;
+        }
+        if constexpr (trivial)
+            task.func.ReleaseTrivial();
+        _ingressDroppedCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Microseconds until the earliest pending task is due: 0 if something is due or waiting in the
+    // ISR ring, UINT64_MAX if nothing is scheduled. Amortized O(1): tombstones found on top of a
+    // lane are popped, which is work Loop() would otherwise do. With the timing wheel this can be
+    // earlier than the real deadline, when the wheel has to turn a higher level first.
+    static uint64_t TimeUntilNextTaskMicros()
+    {
+        if (!_ingress.IsEmpty())
+            return 0;
+        uint64_t currentTime = _now();
+        uint64_t result = UINT64_MAX;
+        for (uint8_t lane = 0; lane < _laneCount; lane++)
+        {
+            auto &timers = _timers(lane);
+            while (timers.Peek() != nullptr && !_isLive(*timers.Peek()))
+            {
+                timers.Pop();
+                _staleCount()--;
+            }
+            uint64_t dueTime;
+            if (!timers.NextDeadline(dueTime))
+                continue;
+            if (dueTime <= currentTime)
+                return 0;
+            result = std::min(result, dueTime - currentTime);
+        }
+        for (const RateLane &lane : _rateLanes())
+        {
+            if (lane.stats.depth == 0)
+                continue;
+            uint64_t releaseTime = _nextRelease(lane);
+            if (releaseTime <= currentTime)
+                return 0;
+            result = std::min(result, releaseTime - currentTime);
+        }
+        return result;
+    }
+
+    // TimeUntilNextTaskMicros() rounded up to milliseconds, ULONG_MAX if nothing is scheduled
+    static unsigned long TimeUntilNextTask()
+    {
+        uint64_t remaining = TimeUntilNextTaskMicros();
+        if (remaining == UINT64_MAX)
+            return ULONG_MAX;
+        return static_cast<unsigned long>(std::min<uint64_t>((remaining + 999) / 1000, ULONG_MAX - 1));
+    }
+
+    // Runs Loop(), then blocks until the next task is due, at most maxSleepMs. On ESP32 the loop
+    // task blocks on a task notification that DispatchFromISR() also signals, which lets FreeRTOS
+    // tickless idle enter light sleep when power management is enabled. On ESP8266 the wait is a
+    // delay(), during which the SDK can enter modem/light sleep as set by WiFi.setSleepMode();
+    // ISR dispatches are then picked up within MAIN_THREAD_DISPATCHER_SLEEP_SLICE_MS.
+    static size_t LoopAndSleep(unsigned long budgetUs = 0, unsigned long maxSleepMs = ULONG_MAX)
+    {
+        size_t backlog = Loop(budgetUs);
+        if (backlog > 0)
+            return backlog;
+        unsigned long sleepMs = std::min(TimeUntilNextTask(), maxSleepMs);
+        if (sleepMs == 0)
+            return 0;
+#if defined(ESP32)
+        _sleeper.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+        // A dispatch that raced with the store above has already left its notification pending
+        if (_ingress.IsEmpty())
+            ulTaskNotifyTake(pdTRUE, sleepMs == ULONG_MAX ? portMAX_DELAY : pdMS_TO_TICKS(sleepMs));
+        _sleeper.store(nullptr, std::memory_order_release);
+#else
+        uint64_t start = _now();
+        while (_ingress.IsEmpty())
+        {
+            uint64_t elapsed = (_now() - start) / 1000;
+            if (elapsed >= sleepMs)
+                break;
+            delay(static_cast<unsigned long>(std::min<uint64_t>(sleepMs - elapsed, MAIN_THREAD_DISPATCHER_SLEEP_SLICE_MS)));
+        }
+#endif
+        return 0;
+    }
+
+    // O(1): the task's timer entry is left in the heap as a tombstone and skipped when it surfaces
+    static bool Cancel(TaskHandle handle)
+    {
+        if (!IsPending(handle))
+            return false;
+        DelayedTask &task = _tasks()[handle.index];
+        // Neither a repeating task cancelled from its own callback nor a task waiting in a rate
+        // lane has a timer entry at this point
+        if (task.rateLane != _noLane)
+            _rateLanes()[task.rateLane].stats.depth--;
+        else if (!task.running)
+            _staleCount()++;
+        _releaseSlot(handle.index);
+        if (_staleCount() >= 32 && _staleCount() * 2 >= _timerCount())
+            _compact();
+        return true;
+    }
+
+    static bool IsPending(TaskHandle handle)
+    {
+        if (!handle.IsValid() || handle.index >= _tasks().size())
+            return false;
+        const DelayedTask &task = _tasks()[handle.index];
+        return task.pending && task.generation == handle.generation;
+    }
+
+    static size_t GetPendingCount() { return _tasks().size() - _freeSlots().size(); }
+
+    // Sets up rate lane `lane` (0 to MAIN_THREAD_DISPATCHER_RATE_LANES - 1) as a token bucket:
+    // its tasks are released in FIFO order at ratePerSec on average, up to burst at once after
+    // an idle period, with at most maxDepth waiting. Rate and burst can be changed at any time,
+    // the depth only while the lane is empty.
+    static bool ConfigureRateLane(uint8_t lane, float ratePerSec, uint16_t burst, uint16_t maxDepth)
+    {
+        if (lane >= MAIN_THREAD_DISPATCHER_RATE_LANES || ratePerSec <= 0 || burst == 0 || maxDepth == 0 || maxDepth > _maxTasks)
+            return false;
+        RateLane &rateLane = _rateLanes()[lane];
+        if (maxDepth != rateLane.queue.size())
+        {
+            if (rateLane.count != 0)
+                return false;
+            rateLane.queue.clear();
+            if (Capacity == 0 && maxDepth > rateLane.queue.capacity())
+                _allocationCount()++;
+            for (uint16_t i = 0; i < maxDepth; i++)
+                rateLane.queue.push_back(TaskHandle());
+            rateLane.head = 0;
         }
+        rateLane.intervalUs = static_cast<uint64_t>(1000000.0f / ratePerSec);
+        if (rateLane.intervalUs == 0)
+            rateLane.intervalUs = 1;
+        rateLane.burstUs = (burst - 1) * rateLane.intervalUs;
+        return true;
     }
 
-    static void Dispatch(std::function<void()> func, long delayMs = 0)
+    // Queues func in a rate lane, e.g. one lane per API so outbound calls are smoothed instead
+    // of bursting into 429 responses. The task holds a slot while it waits, and runs in the same
+    // Loop() that releases it. Returns an invalid handle if the lane is not configured or full,
+    // or the fixed-capacity pool is full.
+    template <typename F>
+    static TaskHandle DispatchRateLimited(uint8_t lane, F &&func, TaskPriority priority = TaskPriority::Normal)
     {
-        DelayedTask task;
-        task.func = func;
-        task.delayMs = delayMs;
-        task.scheduledTime = millis();
-        _tasks().push_back(task);
+        if (lane >= MAIN_THREAD_DISPATCHER_RATE_LANES || _rateLanes()[lane].intervalUs == 0)
+            return TaskHandle();
+        RateLane &rateLane = _rateLanes()[lane];
+        if (rateLane.count == rateLane.queue.size())
+            _compactRateLane(rateLane);
+        if (rateLane.count == rateLane.queue.size())
+        {
+            rateLane.stats.dropped++;
+            return TaskHandle();
+        }
+        if (_freeSlots().empty() && _tasks().size() >= _maxTasks)
+        {
+            _droppedCount()++;
+            return TaskHandle();
+        }
+        if (Capacity == 0 && _mayAllocate<std::decay_t<F>>())
+            _allocationCount()++;
+        uint16_t index = _acquireSlot();
+        DelayedTask &task = _tasks()[index];
+        task.func = Callable(std::forward<F>(func));
+        task.pending = true;
+        task.priority = priority;
+        task.rateLane = lane;
+        // No timer entry until released, but a tombstone of the slot's previous task may still be
+        // queued: a new sequence keeps it from matching
+        task.sequence = _nextSequence()++;
+        TaskHandle handle;
+        handle.index = index;
+        handle.generation = task.generation;
+        rateLane.queue[(rateLane.head + rateLane.count) % rateLane.queue.size()] = handle;
+        rateLane.count++;
+        rateLane.stats.depth++;
+        rateLane.stats.highWater = std::max(rateLane.stats.highWater, rateLane.stats.depth);
+        return handle;
     }
-    
-    static void Dispatch_Ptr(void (*func)(), long delayMs = 0)
+
+    static RateLaneStats GetRateLaneStats(uint8_t lane)
     {
-        Dispatch(std::function<void()>(func), delayMs);
+        return lane < MAIN_THREAD_DISPATCHER_RATE_LANES ? _rateLanes()[lane].stats : RateLaneStats();
     }
 
+    // Tags a pending task for the profile: runs of tasks sharing a name are totalled under it in
+    // DumpProfile(). name is not copied. No-op unless MAIN_THREAD_DISPATCHER_PROFILING is set.
+    static void SetTaskName(TaskHandle handle, const char *name)
+    {
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        if (IsPending(handle))
+            _tasks()[handle.index].profile = _profiler().Register(name);
+#else
+        (void)handle;
+        (void)name;
+#endif
+    }
+
+    // Writes the lateness and execution time histograms and the named task totals as JSON,
+    // e.g. DumpProfile(Serial). Writes {} unless MAIN_THREAD_DISPATCHER_PROFILING is set.
+    template <typename TStream>
+    static void DumpProfile(TStream &out)
+    {
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        _profiler().WriteJson(out);
+#else
+        out.print("{}");
+#endif
+    }
+
+    static void ResetProfile()
+    {
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        _profiler().Reset();
+#endif
+    }
+
+    // Heap allocations made by the dispatcher: container growth, plus every callable that
+    // std::function cannot store inline. Stays at 0 in fixed-capacity mode.
+    static uint32_t GetAllocationCount() { return _allocationCount(); }
+
+    // Dispatches rejected because the fixed-capacity pool or the ISR ring was full
+    static uint32_t GetDroppedCount() { return _droppedCount() + _ingressDroppedCount.load(std::memory_order_relaxed); }
+
 private:
-    static std::vector<DelayedTask> &_tasks() 
+    struct DelayedTask
+    {
+        Callable func;
+        // Sequence of the timer entry currently scheduling this task
+        uint32_t sequence = 0;
+        uint64_t periodUs = 0;
+        uint16_t generation = 1;
+        bool pending = false;
+        bool repeating = false;
+        bool running = false;
+        bool keyed = false;
+        // Leading throttle: window to hold the key for once the task ran, then whether the slot
+        // is only holding it
+        bool holding = false;
+        uint64_t holdUs = 0;
+        uint32_t key = 0;
+        RepeatMode mode = RepeatMode::FixedRate;
+        TaskPriority priority = TaskPriority::Normal;
+        // Rate lane the task is waiting in, _noLane once scheduled
+        uint8_t rateLane = _noLane;
+        // Intrusive list of the tasks in the same group
+        TaskGroup *group = nullptr;
+        uint16_t groupPrev = _noSlot;
+        uint16_t groupNext = _noSlot;
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        uint8_t profile = DispatcherProfiler::None;
+#endif
+    };
+
+    struct TimerEntry
+    {
+        // Microseconds on MonotonicClock
+        uint64_t dueTime;
+        // Dispatch order, used to keep tasks with the same due time in FIFO order
+        uint32_t sequence;
+        uint16_t index;
+    };
+
+    using IngressCallable = InplaceFunction<CallableSize>;
+
+    struct IngressTask
+    {
+        IngressCallable func;
+        uint64_t dueTime = 0;
+        TaskPriority priority = TaskPriority::Normal;
+        // func holds a trivially copyable callable, moved without code from flash
+        bool trivial = false;
+
+        IngressTask() = default;
+
+        // Runs in TryPush() from DispatchFromISR(). Both ends of the ring only ever assign to an
+        // empty task.
+        MTD_ISR_ATTR IngressTask &operator=(IngressTask &&other) noexcept
+        {
+            if (other.trivial)
+                func.MoveTrivialFrom(other.func);
+            else
+                func = std::move(other.func);
+            dueTime = other.dueTime;
+            priority = other.priority;
+            trivial = other.trivial;
+            return *this;
+        }
+    };
+
+    template <typename T, size_t N>
+    using Storage = std::conditional_t<N == 0, std::vector<T>, FixedVector<T, N>>;
+
+    static constexpr size_t _maxTasks = Capacity == 0 ? 0xFFFF : Capacity;
+    static constexpr uint16_t _noSlot = 0xFFFF;
+    static constexpr uint8_t _noLane = 0xFF;
+
+    // Token bucket kept as a generic cell rate algorithm: a task may be released once the
+    // clock reaches the theoretical arrival time minus the burst allowance
+    struct RateLane
+    {
+        // 0 while the lane is not configured
+        uint64_t intervalUs = 0;
+        uint64_t burstUs = 0;
+        uint64_t theoreticalArrival = 0;
+        // FIFO ring of waiting tasks; handles of cancelled tasks stay until skipped
+        Storage<TaskHandle, Capacity> queue;
+        size_t head = 0;
+        size_t count = 0;
+        RateLaneStats stats;
+    };
+    static constexpr uint8_t _laneCount = 3;
+
+    // Min-heap ordering on the due time, then on dispatch order (rollover-safe)
+    static bool _isLater(const TimerEntry &a, const TimerEntry &b)
+    {
+        if (a.dueTime != b.dueTime)
+            return a.dueTime > b.dueTime;
+        return static_cast<int32_t>(a.sequence - b.sequence) > 0;
+    }
+
+    struct _Later
+    {
+        bool operator()(const TimerEntry &a, const TimerEntry &b) const { return _isLater(a, b); }
+    };
+
+    using TimerQueue = std::conditional_t<UseTimingWheel, TimingWheel<TimerEntry, Capacity, _Later>, TimerHeap<TimerEntry, Capacity, _Later>>;
+
+    // False for tombstones: entries whose task was cancelled or rescheduled since
+    static bool _isLive(const TimerEntry &entry)
+    {
+        const DelayedTask &task = _tasks()[entry.index];
+        return task.pending && task.sequence == entry.sequence;
+    }
+
+    // std::function keeps trivially copyable callables of up to two pointers inline
+    template <typename F>
+    static constexpr bool _mayAllocate()
+    {
+        return !(std::is_trivially_copyable<F>::value && sizeof(F) <= 2 * sizeof(void *));
+    }
+
+    template <typename C, typename T>
+    static void _push(C &container, T &&value)
+    {
+        if (container.size() == container.capacity())
+            _allocationCount()++;
+        container.push_back(std::forward<T>(value));
+    }
+
+    static uint64_t _now() { return MonotonicClock::Micros(); }
+
+    static uint64_t _dueIn(long delayMs)
+    {
+        return _now() + (delayMs > 0 ? static_cast<uint64_t>(delayMs) * 1000 : 0);
+    }
+
+    static uint8_t _profileOf(const DelayedTask &task)
+    {
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        return task.profile;
+#else
+        (void)task;
+        return 0;
+#endif
+    }
+
+    static void _run(Callable &func, uint64_t dueTime, uint8_t profile)
+    {
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        uint64_t start = _now();
+        func();
+        _profiler().Record(profile, start - dueTime, _now() - start);
+#else
+        (void)dueTime;
+        (void)profile;
+        func();
+#endif
+    }
+
+    static bool _budgetExhausted(uint64_t startTime, unsigned long budgetUs)
+    {
+        return budgetUs != 0 && _now() - startTime >= budgetUs;
+    }
+
+    static bool _isRunnable(uint8_t lane, uint64_t currentTime, uint32_t endSequence)
+    {
+        const TimerEntry *top = _timers(lane).Peek();
+        if (top == nullptr)
+            return false;
+        return top->dueTime <= currentTime && static_cast<int32_t>(top->sequence - endSequence) < 0;
+    }
+
+    // Picks the highest priority lane with a due task. A lower lane whose oldest due task has
+    // waited longer than MAIN_THREAD_DISPATCHER_AGING_MS goes first if it is also the earlier
+    // deadline, so a busy high lane cannot starve the others.
+    static int _selectLane(uint64_t currentTime, uint32_t endSequence)
+    {
+        int selected = -1;
+        for (uint8_t lane = 0; lane < _laneCount; lane++)
+        {
+            if (!_isRunnable(lane, currentTime, endSequence))
+                continue;
+            if (selected < 0)
+            {
+                selected = lane;
+                continue;
+            }
+            const TimerEntry &top = *_timers(lane).Peek();
+            if (currentTime - top.dueTime >= MAIN_THREAD_DISPATCHER_AGING_MS * 1000ULL && _isLater(*_timers(selected).Peek(), top))
+                selected = lane;
+        }
+        return selected;
+    }
+
+    static MTD_ISR_ATTR void _wakeSleeper()
+    {
+#if defined(ESP32)
+        TaskHandle_t sleeper = _sleeper.load(std::memory_order_acquire);
+        if (sleeper == nullptr)
+            return;
+        if (xPortInIsrContext())
+        {
+            BaseType_t higherPriorityTaskWoken = pdFALSE;
+            vTaskNotifyGiveFromISR(sleeper, &higherPriorityTaskWoken);
+            if (higherPriorityTaskWoken)
+                portYIELD_FROM_ISR();
+        }
+        else
+            xTaskNotifyGive(sleeper);
+#endif
+    }
+
+    static void _drainIngress()
+    {
+        IngressTask task;
+        while (_ingress.TryPop(task))
+            _add(std::move(task.func), task.dueTime, false, 0, RepeatMode::FixedRate, task.priority);
+    }
+
+    template <typename F>
+    static TaskHandle _add(F &&func, uint64_t dueTime, bool repeating, uint64_t periodUs, RepeatMode mode, TaskPriority priority)
+    {
+        if (_freeSlots().empty() && _tasks().size() >= _maxTasks)
+        {
+            _droppedCount()++;
+            return TaskHandle();
+        }
+        if (Capacity == 0 && _mayAllocate<std::decay_t<F>>())
+            _allocationCount()++;
+        uint16_t index = _acquireSlot();
+        DelayedTask &task = _tasks()[index];
+        task.func = Callable(std::forward<F>(func));
+        task.pending = true;
+        task.repeating = repeating;
+        task.periodUs = periodUs;
+        task.mode = mode;
+        task.priority = priority;
+        _schedule(index, dueTime);
+        TaskHandle handle;
+        handle.index = index;
+        handle.generation = task.generation;
+        return handle;
+    }
+
+    static void _schedule(uint16_t index, uint64_t dueTime)
+    {
+        DelayedTask &task = _tasks()[index];
+        task.sequence = _nextSequence()++;
+        TimerEntry entry;
+        entry.dueTime = dueTime;
+        entry.sequence = task.sequence;
+        entry.index = index;
+        auto &timers = _timers(static_cast<uint8_t>(task.priority));
+        if (timers.Full())
+        {
+            _compact();
+            if (timers.Full())
+                _allocationCount()++;
+        }
+        timers.Push(entry, _now());
+    }
+
+    static uint64_t _nextDueTime(const DelayedTask &task, uint64_t lastDueTime, uint64_t now)
+    {
+        if (task.mode == RepeatMode::FixedDelay || task.periodUs == 0)
+            return now + task.periodUs;
+        uint64_t next = lastDueTime + task.periodUs;
+        if (next <= now)
+            next += ((now - next) / task.periodUs + 1) * task.periodUs;
+        return next;
+    }
+
+    static uint16_t _acquireSlot()
+    {
+        if (!_freeSlots().empty())
+        {
+            uint16_t index = _freeSlots().back();
+            _freeSlots().pop_back();
+            return index;
+        }
+        if (_tasks().size() == _tasks().capacity())
+            _allocationCount()++;
+        _tasks().emplace_back();
+        return static_cast<uint16_t>(_tasks().size() - 1);
+    }
+
+    static void _releaseSlot(uint16_t index)
+    {
+        DelayedTask &task = _tasks()[index];
+        task.func = nullptr;
+        task.pending = false;
+        task.repeating = false;
+        task.running = false;
+        task.holding = false;
+        task.holdUs = 0;
+        task.rateLane = _noLane;
+#if MAIN_THREAD_DISPATCHER_PROFILING
+        task.profile = DispatcherProfiler::None;
+#endif
+        if (task.keyed)
+        {
+            _keys().Erase(task.key);
+            task.keyed = false;
+        }
+        _unlinkFromGroup(index);
+        if (++task.generation == 0)
+            task.generation = 1;
+        _push(_freeSlots(), index);
+    }
+
+    static uint64_t _nextRelease(const RateLane &lane)
+    {
+        return lane.theoreticalArrival > lane.burstUs ? lane.theoreticalArrival - lane.burstUs : 0;
+    }
+
+    // Hands waiting tasks whose token is available over to their priority lane
+    static void _releaseRateLanes()
+    {
+        uint64_t now = _now();
+        for (uint8_t lane = 0; lane < MAIN_THREAD_DISPATCHER_RATE_LANES; lane++)
+        {
+            RateLane &rateLane = _rateLanes()[lane];
+            while (rateLane.count != 0)
+            {
+                TaskHandle handle = rateLane.queue[rateLane.head];
+                bool waiting = IsPending(handle) && _tasks()[handle.index].rateLane == lane;
+                if (waiting && _nextRelease(rateLane) > now)
+                    break;
+                rateLane.head = (rateLane.head + 1) % rateLane.queue.size();
+                rateLane.count--;
+                if (!waiting)
+                    continue;
+                rateLane.theoreticalArrival = std::max(rateLane.theoreticalArrival, now) + rateLane.intervalUs;
+                rateLane.stats.depth--;
+                rateLane.stats.released++;
+                _tasks()[handle.index].rateLane = _noLane;
+                _schedule(handle.index, now);
+            }
+        }
+    }
+
+    // Drops the handles of cancelled tasks from a full ring
+    static void _compactRateLane(RateLane &lane)
+    {
+        size_t kept = 0;
+        size_t size = lane.queue.size();
+        for (size_t i = 0; i < lane.count; i++)
+        {
+            TaskHandle handle = lane.queue[(lane.head + i) % size];
+            if (IsPending(handle) && _tasks()[handle.index].rateLane != _noLane)
+                lane.queue[(lane.head + kept++) % size] = handle;
+        }
+        lane.count = kept;
+    }
+
+    static void _unlinkFromGroup(uint16_t index)
+    {
+        DelayedTask &task = _tasks()[index];
+        if (task.group == nullptr)
+            return;
+        if (task.groupPrev == _noSlot)
+            task.group->_head = task.groupNext;
+        else
+            _tasks()[task.groupPrev].groupNext = task.groupNext;
+        if (task.groupNext != _noSlot)
+            _tasks()[task.groupNext].groupPrev = task.groupPrev;
+        task.group->_count--;
+        task.group = nullptr;
+        task.groupPrev = _noSlot;
+        task.groupNext = _noSlot;
+    }
+
+    // Drops tombstones from the timer queues. Runs once tombstones make up half of the
+    // entries, or when a queue is full, so cancels stay amortized O(1)
+    static void _compact()
+    {
+        if (_staleCount() == 0)
+            return;
+        auto isStale = [](const TimerEntry &entry) { return !_isLive(entry); };
+        for (uint8_t lane = 0; lane < _laneCount; lane++)
+            _timers(lane).RemoveIf(isStale);
+        _staleCount() = 0;
+    }
+
+    using KeyIndexStorage = std::conditional_t<Capacity == 0, DynamicKeyIndex, FixedKeyIndex<Capacity>>;
+
+    // Everything that holds tasks, built on first use and destroyed as one at exit, so there is
+    // a single point after which TaskGroup destructors must leave the slots alone
+    struct State
     {
-        static std::vector<DelayedTask> instance;
+        Storage<DelayedTask, Capacity> tasks;
+        Storage<uint16_t, Capacity> freeSlots;
+        // One deadline-ordered timer queue per priority lane
+        TimerQueue timers[_laneCount];
+        KeyIndexStorage keys;
+        RateLane rateLanes[MAIN_THREAD_DISPATCHER_RATE_LANES];
+
+        ~State() { _stateDestroyed = true; }
+    };
+
+    static State &_state()
+    {
+        static State instance;
+        return instance;
+    }
+
+    static Storage<DelayedTask, Capacity> &_tasks() { return _state().tasks; }
+    static Storage<uint16_t, Capacity> &_freeSlots() { return _state().freeSlots; }
+    static TimerQueue &_timers(uint8_t lane) { return _state().timers[lane]; }
+
+    static size_t _timerCount()
+    {
+        size_t count = 0;
+        for (uint8_t lane = 0; lane < _laneCount; lane++)
+            count += _timers(lane).Size();
+        return count;
+    }
+
+    static KeyIndexStorage &_keys() { return _state().keys; }
+
+    static uint32_t &_nextSequence()
+    {
+        static uint32_t instance = 0;
         return instance;
     }
+
+    static size_t &_staleCount()
+    {
+        static size_t instance = 0;
+        return instance;
+    }
+
+    static size_t &_backlog()
+    {
+        static size_t instance = 0;
+        return instance;
+    }
+
+    static uint32_t &_allocationCount()
+    {
+        static uint32_t instance = 0;
+        return instance;
+    }
+
+    static uint32_t &_droppedCount()
+    {
+        static uint32_t instance = 0;
+        return instance;
+    }
+
+    static RateLane (&_rateLanes())[MAIN_THREAD_DISPATCHER_RATE_LANES] { return _state().rateLanes; }
+
+#if MAIN_THREAD_DISPATCHER_PROFILING
+    static DispatcherProfiler &_profiler()
+    {
+        static DispatcherProfiler instance;
+        return instance;
+    }
+#endif
+
+    // Set by ~State(), constant-initialized so it is still readable after every destructor ran
+    static inline bool _stateDestroyed = false;
+    // Not function-local statics: their lazy-initialization guard is not safe to enter from an ISR
+    static inline BoundedMpmcQueue<IngressTask, MAIN_THREAD_DISPATCHER_INGRESS_CAPACITY> _ingress;
+    static inline std::atomic<uint32_t> _ingressDroppedCount{0};
+#if defined(ESP32)
+    // Loop task blocked in LoopAndSleep(), if any
+    static inline std::atomic<TaskHandle_t> _sleeper{nullptr};
+#endif
 };
+
+using MainThreadDispatcher = BasicMainThreadDispatcher<MAIN_THREAD_DISPATCHER_CAPACITY, MAIN_THREAD_DISPATCHER_CALLABLE_SIZE, MAIN_THREAD_DISPATCHER_USE_TIMING_WHEEL>;
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#if defined(ESP32)
+#include <esp_timer.h>
+#endif
+
+#ifndef MTD_ISR_ATTR
+#if defined(IRAM_ATTR)
+#define MTD_ISR_ATTR IRAM_ATTR
+#else
+#define MTD_ISR_ATTR
+#endif
+#endif
+
+// 64-bit microsecond clock starting at boot. It does not wrap in practice (about 584,000 years),
+// so deadlines compare with plain < instead of rollover-prone signed differences.
+// Sources: esp_timer on ESP32, micros64() on ESP8266, micros() extended to 64 bits elsewhere.
+class MonotonicClock
+{
+public:
+    using Source = uint64_t (*)();
+
+    // Safe to call from interrupt handlers
+    static MTD_ISR_ATTR uint64_t Micros()
+    {
+        Source source = _source.load(std::memory_order_relaxed);
+        return source != nullptr ? source() : _defaultMicros();
+    }
+
+    // Replaces the clock, e.g. with a virtual clock in host tests; nullptr restores the default.
+    // Must return non-decreasing values.
+    static void SetSource(Source source) { _source.store(source, std::memory_order_relaxed); }
+
+    // Extends a wrapping 32-bit microsecond counter to 64 bits. Needs to be sampled at least
+    // once per wrap (about 71 minutes), which any running loop does.
+    static MTD_ISR_ATTR uint64_t Extend32(uint32_t sample)
+    {
+        uint64_t last = _extended.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            uint64_t high = last & ~0xFFFFFFFFULL;
+            // A sample below the last one means the counter wrapped. Samples racing from an
+            // interrupt can be slightly older, so only a large step back counts as a wrap.
+            uint32_t lastLow = static_cast<uint32_t>(last);
+            if (sample < lastLow && lastLow - sample > 0x80000000U)
+                high += 0x100000000ULL;
+            else if (sample < lastLow)
+                return high | sample;
+            uint64_t extended = high | sample;
+            if (_extended.compare_exchange_weak(last, extended, std::memory_order_relaxed))
+                return extended;
+        }
+    }
+
+private:
+    static MTD_ISR_ATTR uint64_t _defaultMicros()
+    {
+#if defined(ESP32)
+        return static_cast<uint64_t>(esp_timer_get_time());
+#elif defined(ESP8266)
+        return micros64();
+#else
+        return Extend32(static_cast<uint32_t>(micros()));
+#endif
+    }
+
+    static inline std::atomic<Source> _source{nullptr};
+    static inline std::atomic<uint64_t> _extended{0};
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "FixedVector.hpp"
+
+// Binary min-heap timer queue: O(log n) insert and expire. Entries need a uint64_t dueTime member
+// in microseconds; Later orders them (due time, then dispatch order). Capacity 0 grows on demand.
+template <typename Entry, size_t Capacity, typename Later>
+class TimerHeap
+{
+public:
+    bool Empty() const { return _entries.empty(); }
+    size_t Size() const { return _entries.size(); }
+
+    // True when the next Push() has to grow the storage (or cannot fit, with a fixed capacity)
+    bool Full() const { return _entries.size() == _entries.capacity(); }
+
+    void Push(const Entry &entry, uint64_t)
+    {
+        _entries.push_back(entry);
+        std::push_heap(_entries.begin(), _entries.end(), Later());
+    }
+
+    // Earliest entry, whether due or not
+    const Entry *Peek() const { return _entries.empty() ? nullptr : &_entries.front(); }
+
+    void Pop()
+    {
+        std::pop_heap(_entries.begin(), _entries.end(), Later());
+        _entries.pop_back();
+    }
+
+    // The heap is always exact, nothing to catch up on
+    void Advance(uint64_t) { }
+
+    bool NextDeadline(uint64_t &dueTime) const
+    {
+        if (_entries.empty())
+            return false;
+        dueTime = _entries.front().dueTime;
+        return true;
+    }
+
+    template <typename Pred>
+    void RemoveIf(Pred pred)
+    {
+        _entries.erase(std::remove_if(_entries.begin(), _entries.end(), pred), _entries.end());
+        std::make_heap(_entries.begin(), _entries.end(), Later());
+    }
+
+    // Counts due entries matching isLive. A node that is not due has no due children,
+    // so only the due part of the heap is visited.
+    template <typename Pred>
+    size_t CountDue(uint64_t now, Pred isLive) const { return _countDue(0, now, isLive); }
+
+private:
+    template <typename Pred>
+    size_t _countDue(size_t node, uint64_t now, Pred &isLive) const
+    {
+        if (node >= _entries.size())
+            return 0;
+        const Entry &entry = _entries[node];
+        if (entry.dueTime > now)
+            return 0;
+        return (isLive(entry) ? 1 : 0) + _countDue(node * 2 + 1, now, isLive) + _countDue(node * 2 + 2, now, isLive);
+    }
+
+    std::conditional_t<Capacity == 0, std::vector<Entry>, FixedVector<Entry, Capacity>> _entries;
+};
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "FixedVector.hpp"
+
+// Number of 64-slot wheels. Each level covers 64 times the span of the one below, so 4 levels
+// with 1 ms ticks reach about 4.6 hours; later deadlines park on the last level and are
+// re-filed as the wheel turns.
+#ifndef MAIN_THREAD_DISPATCHER_WHEEL_LEVELS
+#define MAIN_THREAD_DISPATCHER_WHEEL_LEVELS 4
+#endif
+
+// Wheel resolution. Deadlines are rounded up to a tick, so a task never runs early and at most
+// one tick late; tasks expiring in the same tick run in dispatch order.
+#ifndef MAIN_THREAD_DISPATCHER_WHEEL_TICK_US
+#define MAIN_THREAD_DISPATCHER_WHEEL_TICK_US 1000
+#endif
+
+// Hierarchical timing wheel timer queue, a drop-in alternative to TimerHeap for very large
+// timer counts: O(1) insert, and expiry costs O(1) per entry plus one re-file per level crossed.
+// Entries are kept in intrusive lists over a node pool, so nothing is allocated per timer in
+// fixed-capacity mode. Expired entries run in tick order and FIFO within a tick.
+template <typename Entry, size_t Capacity, typename Later>
+class TimingWheel
+{
+    static_assert(MAIN_THREAD_DISPATCHER_WHEEL_LEVELS >= 1 && MAIN_THREAD_DISPATCHER_WHEEL_LEVELS * 6 < 64, "Invalid number of wheel levels");
+    static_assert(MAIN_THREAD_DISPATCHER_WHEEL_TICK_US >= 1, "Invalid wheel tick");
+
+public:
+    TimingWheel()
+    {
+        for (uint8_t level = 0; level < _levels; level++)
+        {
+            for (uint8_t slot = 0; slot < _slots; slot++)
+                _buckets[level][slot] = List();
+            _bitmaps[level] = 0;
+        }
+    }
+
+    bool Empty() const { return _size == 0; }
+    size_t Size() const { return _size; }
+
+    // True when the next Push() has to grow the node pool (or cannot fit, with a fixed capacity)
+    bool Full() const { return _free == _none && _nodes.size() == _nodes.capacity(); }
+
+    // now lets an idle wheel jump to the current tick instead of turning through the gap later,
+    // and entries already due skip the round-up to the next tick
+    void Push(const Entry &entry, uint64_t now)
+    {
+        if (_bucketsEmpty())
+            _current = now / _tickUs;
+        Index node;
+        if (_free != _none)
+        {
+            node = _free;
+            _free = _nodes[node].next;
+            _nodes[node].entry = entry;
+        }
+        else
+        {
+            node = static_cast<Index>(_nodes.size());
+            _nodes.push_back(Node{entry, _none});
+        }
+        _size++;
+        if (entry.dueTime <= now)
+            _append(_ready, node);
+        else
+            _file(node);
+    }
+
+    // Oldest expired entry, nullptr until Advance() has moved something past its deadline
+    const Entry *Peek() const { return _ready.head == _none ? nullptr : &_nodes[_ready.head].entry; }
+
+    void Pop()
+    {
+        Index node = _ready.head;
+        _ready.head = _nodes[node].next;
+        if (_ready.head == _none)
+            _ready.tail = _none;
+        _release(node);
+    }
+
+    // Turns the wheel up to now, moving expired entries to the ready list. The occupancy
+    // bitmaps give the next tick with work, so empty slots on every level are skipped in one
+    // step and a gap of hours costs the same as a gap of one tick.
+    void Advance(uint64_t now)
+    {
+        uint64_t nowTick = now / _tickUs;
+        while (_current <= nowTick)
+        {
+            uint64_t tick = _nextTick();
+            if (tick > nowTick)
+                break;
+            _current = tick;
+            uint32_t slot = _current & _slotMask;
+            if (slot == 0)
+                _cascade(1);
+            if (_bitmaps[0] & (1ULL << slot))
+                _expire(slot);
+            _current++;
+        }
+        _current = std::max(_current, nowTick + 1);
+    }
+
+    // Exact for expired and level 0 entries, otherwise the start of the earliest occupied
+    // higher level slot: a lower bound at which the wheel has to be advanced again
+    bool NextDeadline(uint64_t &dueTime) const
+    {
+        if (_ready.head != _none)
+        {
+            dueTime = _nodes[_ready.head].entry.dueTime;
+            return true;
+        }
+        if (_bucketsEmpty())
+            return false;
+        dueTime = _nextTick() * _tickUs;
+        return true;
+    }
+
+    template <typename Pred>
+    void RemoveIf(Pred pred)
+    {
+        for (uint8_t level = 0; level < _levels; level++)
+        {
+            for (uint8_t slot = 0; slot < _slots; slot++)
+            {
+                _removeIf(_buckets[level][slot], pred);
+                if (_buckets[level][slot].head == _none)
+                    _bitmaps[level] &= ~(1ULL << slot);
+            }
+        }
+        _removeIf(_ready, pred);
+    }
+
+    // Everything due as of the last Advance() sits in the ready list
+    template <typename Pred>
+    size_t CountDue(uint64_t, Pred isLive) const
+    {
+        size_t count = 0;
+        for (Index node = _ready.head; node != _none; node = _nodes[node].next)
+        {
+            if (isLive(_nodes[node].entry))
+                count++;
+        }
+        return count;
+    }
+
+private:
+    using Index = std::conditional_t<Capacity != 0 && Capacity < 0xFFFF, uint16_t, uint32_t>;
+
+    struct Node
+    {
+        Entry entry;
+        Index next;
+    };
+
+    struct List
+    {
+        Index head = _none;
+        Index tail = _none;
+    };
+
+    static constexpr Index _none = static_cast<Index>(~Index(0));
+    static constexpr uint8_t _levels = MAIN_THREAD_DISPATCHER_WHEEL_LEVELS;
+    static constexpr uint8_t _slotBits = 6;
+    static constexpr uint32_t _slots = 1U << _slotBits;
+    static constexpr uint32_t _slotMask = _slots - 1;
+    static constexpr uint64_t _tickUs = MAIN_THREAD_DISPATCHER_WHEEL_TICK_US;
+
+    // First tick from _current on with work: an occupied level 0 slot, or the start of an
+    // occupied higher level slot, which has to be cascaded. UINT64_MAX when the wheel is empty.
+    uint64_t _nextTick() const
+    {
+        uint64_t best = UINT64_MAX;
+        for (uint8_t level = 0; level < _levels; level++)
+        {
+            if (_bitmaps[level] == 0)
+                continue;
+            uint32_t shift = level * _slotBits;
+            // A higher level slot is cascaded as the wheel enters it, so unless _current is its
+            // first tick, the slot holding _current only has entries a full turn ahead
+            uint64_t first = _current >> shift;
+            if ((_current & ((1ULL << shift) - 1)) != 0)
+                first++;
+            uint32_t slot = first & _slotMask;
+            uint64_t rotated = (_bitmaps[level] >> slot) | (slot == 0 ? 0 : _bitmaps[level] << (_slots - slot));
+            best = std::min(best, (first + __builtin_ctzll(rotated)) << shift);
+        }
+        return best;
+    }
+
+    bool _bucketsEmpty() const
+    {
+        for (uint8_t level = 0; level < _levels; level++)
+        {
+            if (_bitmaps[level] != 0)
+                return false;
+        }
+        return true;
+    }
+
+    void _append(List &list, Index node)
+    {
+        _nodes[node].next = _none;
+        if (list.tail == _none)
+            list.head = node;
+        else
+            _nodes[list.tail].next = node;
+        list.tail = node;
+    }
+
+    // Files a node into the level matching its distance from the wheel position
+    void _file(Index node)
+    {
+        // Rounded up, so the tick only expires once the deadline has passed
+        uint64_t due = (_nodes[node].entry.dueTime + _tickUs - 1) / _tickUs;
+        if (due < _current)
+        {
+            _append(_ready, node);
+            return;
+        }
+        uint64_t delta = due - _current;
+        uint8_t level = 0;
+        while (level < _levels - 1 && delta >= (1ULL << (_slotBits * (level + 1))))
+            level++;
+        uint32_t slot;
+        if (level == _levels - 1 && delta >= (1ULL << (_slotBits * _levels)))
+            // Beyond the wheel range: park in the last slot of the top level to be re-filed later
+            slot = ((_current >> (_slotBits * level)) + _slotMask) & _slotMask;
+        else
+            slot = (due >> (_slotBits * level)) & _slotMask;
+        _append(_buckets[level][slot], node);
+        _bitmaps[level] |= 1ULL << slot;
+    }
+
+    void _expire(uint32_t slot)
+    {
+        List &bucket = _buckets[0][slot];
+        if (_ready.tail == _none)
+            _ready.head = bucket.head;
+        else
+            _nodes[_ready.tail].next = bucket.head;
+        _ready.tail = bucket.tail;
+        bucket = List();
+        _bitmaps[0] &= ~(1ULL << slot);
+    }
+
+    // Re-files the slot of `level` that the wheel just entered into the levels below
+    void _cascade(uint8_t level)
+    {
+        if (level >= _levels)
+            return;
+        uint32_t slot = (_current >> (_slotBits * level)) & _slotMask;
+        List bucket = _buckets[level][slot];
+        _buckets[level][slot] = List();
+        _bitmaps[level] &= ~(1ULL << slot);
+        for (Index node = bucket.head; node != _none;)
+        {
+            Index next = _nodes[node].next;
+            _file(node);
+            node = next;
+        }
+        if (slot == 0)
+            _cascade(level + 1);
+    }
+
+    template <typename Pred>
+    void _removeIf(List &list, Pred &pred)
+    {
+        Index previous = _none;
+        for (Index node = list.head; node != _none;)
+        {
+            Index next = _nodes[node].next;
+            if (pred(_nodes[node].entry))
+            {
+                if (previous == _none)
+                    list.head = next;
+                else
+                    _nodes[previous].next = next;
+                if (list.tail == node)
+                    list.tail = previous;
+                _release(node);
+            }
+            else
+                previous = node;
+            node = next;
+        }
+    }
+
+    void _release(Index node)
+    {
+        _nodes[node].next = _free;
+        _free = node;
+        _size--;
+    }
+
+    std::conditional_t<Capacity == 0, std::vector<Node>, FixedVector<Node, Capacity>> _nodes;
+    Index _free = _none;
+    size_t _size = 0;
+    // Next tick to process; everything before it has expired into _ready
+    uint64_t _current = 0;
+    List _buckets[_levels][_slots];
+    uint64_t _bitmaps[_levels];
+    List _ready;
+};
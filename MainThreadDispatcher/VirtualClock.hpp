@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "MonotonicClock.hpp"
+
+// Deterministic clock for host simulations and tests: time only moves when advanced. Installed
+// as the MonotonicClock source, so every dispatcher reads it.
+//
+//     VirtualClock::Install();
+//     MainThreadDispatcher::DispatchRepeating(report, 60000);
+//     VirtualClock::RunFor<MainThreadDispatcher>(24ULL * 3600 * 1000000); // one simulated day
+class VirtualClock
+{
+public:
+    static void Install(uint64_t startUs = 0)
+    {
+        _now.store(startUs, std::memory_order_relaxed);
+        _installed.store(true, std::memory_order_relaxed);
+        MonotonicClock::SetSource(Now);
+    }
+
+    // Gives MonotonicClock back its hardware source
+    static void Uninstall()
+    {
+        _installed.store(false, std::memory_order_relaxed);
+        MonotonicClock::SetSource(nullptr);
+    }
+
+    // Lets host shims turn waits (delay()) into clock advances instead of real sleeps
+    static bool IsInstalled() { return _installed.load(std::memory_order_relaxed); }
+
+    static uint64_t Now() { return _now.load(std::memory_order_relaxed); }
+
+    static void Advance(uint64_t us) { _now.fetch_add(us, std::memory_order_relaxed); }
+
+    // Never moves backwards
+    static void AdvanceTo(uint64_t us)
+    {
+        uint64_t now = Now();
+        while (us > now && !_now.compare_exchange_weak(now, us, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Runs Dispatcher until untilUs, jumping straight from one deadline to the next, so
+    // simulated time costs nothing but the callbacks themselves. Tasks due exactly at untilUs
+    // run. Returns the number of Loop() calls made.
+    template <typename Dispatcher>
+    static size_t RunUntil(uint64_t untilUs)
+    {
+        size_t loops = 0;
+        for (;;)
+        {
+            Dispatcher::Loop();
+            loops++;
+            uint64_t wait = Dispatcher::TimeUntilNextTaskMicros();
+            if (wait == 0)
+                continue;
+            uint64_t now = Now();
+            if (wait == UINT64_MAX || wait > untilUs - now || now >= untilUs)
+                break;
+            Advance(wait);
+        }
+        AdvanceTo(untilUs);
+        return loops;
+    }
+
+    template <typename Dispatcher>
+    static size_t RunFor(uint64_t us) { return RunUntil<Dispatcher>(Now() + us); }
+
+private:
+    static inline std::atomic<uint64_t> _now{0};
+    static inline std::atomic<bool> _installed{false};
+};
@@ -0,0 +1,369 @@
+#pragma once
+
+#if defined(ESP32) || !defined(ARDUINO)
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include "BoundedMpmcQueue.hpp"
+#include "InplaceFunction.hpp"
+#include "MainThreadDispatcher.hpp"
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+// Worker count, one per core by default on ESP32
+#ifndef WORK_STEALING_EXECUTOR_WORKERS
+#define WORK_STEALING_EXECUTOR_WORKERS 2
+#endif
+
+// Jobs that can be queued or running at once, a power of two
+#ifndef WORK_STEALING_EXECUTOR_CAPACITY
+#define WORK_STEALING_EXECUTOR_CAPACITY 32
+#endif
+
+// Bytes available in place for a job and its completion
+#ifndef WORK_STEALING_EXECUTOR_JOB_SIZE
+#define WORK_STEALING_EXECUTOR_JOB_SIZE 48
+#endif
+
+#ifndef WORK_STEALING_EXECUTOR_STACK_SIZE
+#define WORK_STEALING_EXECUTOR_STACK_SIZE 4096
+#endif
+
+#ifndef WORK_STEALING_EXECUTOR_PRIORITY
+#define WORK_STEALING_EXECUTOR_PRIORITY 1
+#endif
+
+// Chase-Lev work-stealing deque of job indices. The owning worker pushes and pops at the
+// bottom, other workers steal from the top. Never holds more than Capacity entries because
+// there are only Capacity jobs in total. The indices are free-running and wrap around, so only
+// their difference is meaningful.
+template <size_t Capacity>
+class WorkStealingDeque
+{
+public:
+    // Owner only
+    void Push(uint16_t job)
+    {
+        uint32_t bottom = _bottom.load(std::memory_order_relaxed);
+        _buffer[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+        _bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    bool Pop(uint16_t &job)
+    {
+        uint32_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t top = _top.load(std::memory_order_relaxed);
+        int32_t size = _distance(top, bottom);
+        if (size < 0)
+        {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        job = _buffer[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (size == 0)
+        {
+            // Last entry, race the thieves for it
+            bool won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread. Fails only on an empty deque; a race lost to another thief or to the owner
+    // is retried, so an idle worker never goes to sleep while there is something to steal.
+    bool Steal(uint16_t &job)
+    {
+        for (;;)
+        {
+            uint32_t top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint32_t bottom = _bottom.load(std::memory_order_acquire);
+            if (_distance(top, bottom) <= 0)
+                return false;
+            job = _buffer[top & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+private:
+    // to - from, correct across wrap-around as long as the two are less than 2^31 apart
+    static int32_t _distance(uint32_t from, uint32_t to) { return static_cast<int32_t>(to - from); }
+
+    std::atomic<uint32_t> _top{0};
+    std::atomic<uint32_t> _bottom{0};
+    std::atomic<uint16_t> _buffer[Capacity];
+};
+
+// Runs CPU-bound jobs (JSON serialization, form encoding...) on worker tasks pinned to each
+// core, and posts their completions back to the main loop through Dispatcher::DispatchFromISR().
+// Jobs submitted from outside go through an injection queue; jobs submitted by a job go to that
+// worker's own deque, and idle workers steal from the others. Job storage is a fixed pool.
+// Jobs must not touch anything owned by the main loop, only their completions may.
+template <typename Dispatcher, size_t Workers = WORK_STEALING_EXECUTOR_WORKERS, size_t Capacity = WORK_STEALING_EXECUTOR_CAPACITY, size_t JobSize = WORK_STEALING_EXECUTOR_JOB_SIZE>
+class BasicWorkStealingExecutor
+{
+    static_assert(Workers >= 1, "At least one worker is needed");
+    static_assert(Capacity >= 2 && Capacity <= 0x8000 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    using Job = InplaceFunction<JobSize>;
+
+    // Starts the workers, once
+    static bool Start()
+    {
+        if (_running.exchange(true))
+            return false;
+        static bool poolReady = _fillPool();
+        (void)poolReady;
+#if defined(ESP32)
+        for (size_t i = 0; i < Workers; i++)
+        {
+            if (xTaskCreatePinnedToCore(_workerMain, "executor", WORK_STEALING_EXECUTOR_STACK_SIZE, reinterpret_cast<void *>(i), WORK_STEALING_EXECUTOR_PRIORITY, &_workerTasks[i], i % portNUM_PROCESSORS) != pdPASS)
+                return false;
+        }
+#else
+        for (size_t i = 0; i < Workers; i++)
+            _workerThreads[i] = std::thread(_workerMain, reinterpret_cast<void *>(i));
+#endif
+        return true;
+    }
+
+    // Lets the workers finish the queued jobs and waits for them to exit (host builds only;
+    // on ESP32 the workers run for the lifetime of the firmware)
+    static void Stop()
+    {
+#if !defined(ESP32)
+        _stopping = true;
+        _wakeWorkers(true);
+        for (size_t i = 0; i < Workers; i++)
+        {
+            if (_workerThreads[i].joinable())
+                _workerThreads[i].join();
+        }
+        _stopping = false;
+        _running = false;
+#endif
+    }
+
+    // Runs job on a worker. Callable from any thread. Returns false when the job pool is full.
+    template <typename F>
+    static bool Submit(F &&job)
+    {
+        uint16_t index;
+        if (!_freeJobs.TryPop(index))
+        {
+            _rejectedCount++;
+            return false;
+        }
+        _jobs[index] = Job(std::forward<F>(job));
+        _pendingCount++;
+        if (_currentWorker >= 0)
+            _deques[_currentWorker].Push(index);
+        else
+            _injection.TryPush(index);
+        _wakeWorkers(false);
+        return true;
+    }
+
+    // Runs job on a worker, then completion on the main loop. A value returned by job is passed
+    // to completion, so both must fit the dispatcher's in-place callable size together, and
+    // must be copyable.
+    template <typename F, typename C>
+    static bool Submit(F &&job, C &&completion)
+    {
+        return Submit([job = std::forward<F>(job), completion = std::forward<C>(completion)]() mutable {
+            if constexpr (std::is_void<std::invoke_result_t<std::decay_t<F> &>>::value)
+            {
+                job();
+                _post(completion);
+            }
+            else
+            {
+                _post([completion = std::move(completion), result = job()]() mutable { completion(std::move(result)); });
+            }
+        });
+    }
+
+    // Jobs submitted and not finished yet
+    static size_t GetPendingCount() { return _pendingCount.load(std::memory_order_relaxed); }
+
+    // Submissions refused because the job pool was full
+    static uint32_t GetRejectedCount() { return _rejectedCount.load(std::memory_order_relaxed); }
+
+    // Jobs a worker took from another worker's deque
+    static uint32_t GetStolenCount() { return _stolenCount.load(std::memory_order_relaxed); }
+
+private:
+    static bool _fillPool()
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            _freeJobs.TryPush(static_cast<uint16_t>(i));
+        return true;
+    }
+
+    // A completion is never dropped: wait for room in the dispatcher's ingress ring. A failed
+    // push consumes its argument, so every attempt posts a copy.
+    template <typename C>
+    static void _post(const C &completion)
+    {
+        while (!Dispatcher::DispatchFromISR(completion))
+            _pause();
+    }
+
+    static void _pause()
+    {
+#if defined(ESP32)
+        vTaskDelay(1);
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+    }
+
+    static bool _take(size_t worker, uint16_t &index)
+    {
+        if (_deques[worker].Pop(index) || _injection.TryPop(index))
+            return true;
+        for (size_t offset = 1; offset < Workers; offset++)
+        {
+            if (_deques[(worker + offset) % Workers].Steal(index))
+            {
+                _stolenCount++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void _run(uint16_t index)
+    {
+        Job job = std::move(_jobs[index]);
+        _jobs[index] = nullptr;
+        _freeJobs.TryPush(index);
+        job();
+#if defined(ESP32)
+        _pendingCount--;
+#else
+        // The last job lets the workers waiting for it in Stop() exit
+        if (--_pendingCount == 0 && _stopping)
+            _wakeWorkers(true);
+#endif
+    }
+
+    static void _workerMain(void *arg)
+    {
+        size_t worker = reinterpret_cast<size_t>(arg);
+        _currentWorker = static_cast<int>(worker);
+        for (;;)
+        {
+            uint16_t index;
+            if (_take(worker, index))
+            {
+                _run(index);
+                continue;
+            }
+            // Announce the sleep, then look once more: a Submit() racing with this either
+            // sees the flag and wakes this worker, or pushed its job before the second look
+            _sleeping[worker].store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_take(worker, index))
+            {
+                _sleeping[worker].store(false, std::memory_order_relaxed);
+                _run(index);
+                continue;
+            }
+#if !defined(ESP32)
+            // Checked after the flag too, so Stop() either sees it or is seen here
+            if (_stopping && _pendingCount == 0)
+            {
+                _sleeping[worker].store(false, std::memory_order_relaxed);
+                break;
+            }
+#endif
+            _sleep(worker);
+        }
+#if defined(ESP32)
+        vTaskDelete(nullptr);
+#endif
+    }
+
+    // Blocks until a waker clears this worker's flag. A notification left over from an earlier
+    // wake-up returns early and is absorbed by the loop.
+    static void _sleep(size_t worker)
+    {
+#if defined(ESP32)
+        while (_sleeping[worker].load(std::memory_order_acquire))
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepCondition.wait(lock, [worker] { return !_sleeping[worker].load(std::memory_order_acquire); });
+#endif
+    }
+
+    // Wakes one sleeping worker after a job was pushed, or every worker. Only the waker that
+    // clears a worker's flag notifies it, so each wake-up is delivered once.
+    static void _wakeWorkers(bool all)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t first = _nextWake++;
+        for (size_t i = 0; i < Workers; i++)
+        {
+            size_t worker = (first + i) % Workers;
+            if (!_sleeping[worker].load(std::memory_order_relaxed) || !_sleeping[worker].exchange(false, std::memory_order_acq_rel))
+                continue;
+#if defined(ESP32)
+            // The handle is set before the task runs, so before it can sleep
+            xTaskNotifyGive(_workerTasks[worker]);
+#else
+            // Taking the mutex orders the cleared flag before the sleeper's check of it
+            {
+                std::lock_guard<std::mutex> lock(_sleepMutex);
+            }
+            _sleepCondition.notify_all();
+#endif
+            if (!all)
+                return;
+        }
+    }
+
+    static inline Job _jobs[Capacity];
+    static inline BoundedMpmcQueue<uint16_t, Capacity> _freeJobs;
+    static inline BoundedMpmcQueue<uint16_t, Capacity> _injection;
+    static inline WorkStealingDeque<Capacity> _deques[Workers];
+    static inline std::atomic<bool> _running{false};
+    static inline std::atomic<size_t> _pendingCount{0};
+    static inline std::atomic<uint32_t> _rejectedCount{0};
+    static inline std::atomic<uint32_t> _stolenCount{0};
+    // Index of the worker running on this thread, -1 elsewhere
+    static inline thread_local int _currentWorker = -1;
+    // Set by a worker about to block, cleared by whoever wakes it
+    static inline std::atomic<bool> _sleeping[Workers] = {};
+    static inline std::atomic<uint32_t> _nextWake{0};
+#if defined(ESP32)
+    static inline TaskHandle_t _workerTasks[Workers] = {};
+#else
+    static inline std::thread _workerThreads[Workers];
+    static inline std::atomic<bool> _stopping{false};
+    static inline std::mutex _sleepMutex;
+    static inline std::condition_variable _sleepCondition;
+#endif
+};
+
+using WorkStealingExecutor = BasicWorkStealingExecutor<MainThreadDispatcher>;
+
+#endif
@@ -0,0 +1,87 @@
+// Drives the dispatcher across the wrap of 32-bit clocks. The first part feeds a wrapping 32-bit
+// microsecond counter through MonotonicClock::Extend32(), the way the default source extends
+// micros(); the second starts VirtualClock just before the shim's 32-bit millis() wraps. Delayed
+// and repeating tasks due on both sides of the wrap must run in order and on time.
+
+#include <Arduino.h>
+#include <vector>
+#include "HostCheck.hpp"
+#include "MainThreadDispatcher.hpp"
+
+using Dispatcher = MainThreadDispatcher;
+
+struct Run
+{
+    char id;
+    // Milliseconds since the start of the scenario
+    uint32_t atMs;
+};
+
+static std::vector<Run> runs;
+static uint32_t elapsedMs = 0;
+
+static void Record(char id) { runs.push_back({id, elapsedMs}); }
+
+// Dispatches the same tasks in both scenarios, starting 50 ms before the wrap
+static void DispatchAcrossWrap()
+{
+    runs.clear();
+    elapsedMs = 0;
+    Dispatcher::Dispatch([] { Record('a'); }, 20);
+    Dispatcher::Dispatch([] { Record('b'); }, 80);
+    Dispatcher::Dispatch([] { Record('c'); }, 50);
+    TaskHandle repeating = Dispatcher::DispatchRepeating([] { Record('r'); }, 30);
+    // Cancels the repeating task after its fourth run, 70 ms past the wrap
+    Dispatcher::Dispatch([repeating] { Dispatcher::Cancel(repeating); }, 125);
+}
+
+static void CheckRuns()
+{
+    const Run expected[] = {{'a', 20}, {'r', 30}, {'c', 50}, {'r', 60}, {'b', 80}, {'r', 90}, {'r', 120}};
+    HOST_CHECK(runs.size() == sizeof(expected) / sizeof(expected[0]));
+    for (size_t i = 0; i < runs.size() && i < sizeof(expected) / sizeof(expected[0]); i++)
+    {
+        HOST_CHECK(runs[i].id == expected[i].id);
+        HOST_CHECK(runs[i].atMs == expected[i].atMs);
+    }
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+}
+
+static uint32_t counterUs = 0;
+
+static uint64_t WrappingMicros() { return MonotonicClock::Extend32(counterUs); }
+
+int main()
+{
+    {
+        // 32-bit microsecond counter wrapping 50 ms in
+        counterUs = 0xFFFFFFFFU - 50000 + 1;
+        MonotonicClock::SetSource(WrappingMicros);
+        uint64_t before = MonotonicClock::Micros();
+        DispatchAcrossWrap();
+        for (; elapsedMs < 200; elapsedMs++)
+        {
+            Dispatcher::Loop();
+            counterUs += 1000;
+        }
+        HOST_CHECK(counterUs < 200000);
+        HOST_CHECK(MonotonicClock::Micros() - before == 200000);
+        CheckRuns();
+        MonotonicClock::SetSource(nullptr);
+    }
+
+    {
+        // millis() wrapping 50 ms in, with LoopAndSleep() computing the sleeps
+        VirtualClock::Install((0x100000000ULL - 50) * 1000);
+        unsigned long startMs = millis();
+        DispatchAcrossWrap();
+        while (Dispatcher::GetPendingCount() > 0)
+        {
+            elapsedMs = static_cast<uint32_t>(millis() - startMs);
+            Dispatcher::LoopAndSleep(0, 1000);
+        }
+        HOST_CHECK(millis() < startMs);
+        CheckRuns();
+    }
+    return HostCheckResult();
+}
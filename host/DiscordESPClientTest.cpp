@@ -0,0 +1,286 @@
+// Sends DiscordESP requests through the shim's socket to FakeServer: what goes on the wire, when
+// a kept-alive connection is reused or a request sent again, the asynchronous queue driven by
+// Loop() and blocking requests waiting behind it, and requests held back by the rate limits the
+// responses report.
+
+#include <Arduino.h>
+#include <vector>
+#include "DiscordESP.hpp"
+#include "FakeServer.hpp"
+#include "HostCheck.hpp"
+
+static const char WebhookUrl[] = "https://discord.com/api/webhooks/1/abc";
+static const char Token[] = "token";
+
+static String Ok(const char *json = "{\"id\":\"1\"}", const char *headers = "") { return FakeServer::JsonResponse(200, json, headers); }
+
+// Loop() until the queue is empty, for at most limitMs of virtual time
+static void DrainQueue(DiscordESPClient &client, unsigned long limitMs = 10000)
+{
+    unsigned long start = millis();
+    while (client.GetQueuedCount() > 0 && millis() - start < limitMs)
+    {
+        client.Loop();
+        delay(1);
+    }
+}
+
+static void KeepAlive()
+{
+    FakeServer::Reset();
+    DiscordESPClient client;
+    client.Setup();
+    FakeServer::Reply(Ok());
+    FakeServer::Reply(Ok("{\"id\":\"2\"}"));
+    FakeServer::Reply(FakeServer::ChunkedJsonResponse(200, "{\"id\":\"3\"}"));
+    FakeServer::Reply(Ok("{\"id\":\"4\"}"));
+
+    DiscordESPResponse first = client.Webhook.SendMessage(WebhookUrl, "first");
+    HOST_CHECK(first.errorCode == DiscordESPResponseCode::Success && !first.connectionReused);
+    HOST_CHECK(first.responseData[F("id")].as<String>() == "1");
+    DiscordESPResponse second = client.Webhook.SendMessage(WebhookUrl, "second");
+    HOST_CHECK(second.errorCode == DiscordESPResponseCode::Success && second.connectionReused);
+    HOST_CHECK(second.responseData[F("id")].as<String>() == "2");
+    // A chunked body read to its end leaves the connection usable too
+    DiscordESPResponse third = client.Bot.SendMessage(Token, "42", "third");
+    HOST_CHECK(third.errorCode == DiscordESPResponseCode::Success && third.connectionReused);
+    HOST_CHECK(third.responseData[F("id")].as<String>() == "3");
+    DiscordESPResponse fourth = client.Bot.SendMessage(Token, "42", "fourth");
+    HOST_CHECK(fourth.errorCode == DiscordESPResponseCode::Success && fourth.connectionReused);
+    HOST_CHECK(FakeServer::GetConnectCount() == 1);
+
+    const std::vector<FakeRequest> &requests = FakeServer::GetRequests();
+    HOST_CHECK(requests.size() == 4);
+    if (requests.size() == 4)
+    {
+        HOST_CHECK(requests[0].method == "POST" && requests[0].path == "/api/webhooks/1/abc?wait=true");
+        HOST_CHECK(requests[0].GetHeader("Host") == "discord.com");
+        HOST_CHECK(requests[0].GetHeader("Connection") == "keep-alive");
+        HOST_CHECK(requests[0].GetHeader("Authorization").isEmpty());
+        HOST_CHECK(requests[0].body == "{\"content\":\"first\"}");
+        HOST_CHECK(requests[0].GetHeader("Content-Length").toInt() == static_cast<long>(requests[0].body.length()));
+        HOST_CHECK(requests[2].path == "/api/v10/channels/42/messages");
+        HOST_CHECK(requests[2].GetHeader("Authorization") == "Bot token");
+        HOST_CHECK(requests[3].body == "{\"content\":\"fourth\"}");
+    }
+
+    // Idle for longer than the keep-alive timeout: a new connection
+    FakeServer::Reply(Ok());
+    delay(DISCORD_ESP_KEEP_ALIVE_IDLE_MS + 1);
+    DiscordESPResponse idle = client.Webhook.SendMessage(WebhookUrl, "idle");
+    HOST_CHECK(idle.errorCode == DiscordESPResponseCode::Success && !idle.connectionReused);
+    HOST_CHECK(FakeServer::GetConnectCount() == 2);
+
+    // Without keep-alive every request has its own connection
+    client.SetKeepAlive(false);
+    FakeServer::Reply(Ok(), 0, true);
+    FakeServer::Reply(Ok(), 0, true);
+    client.Webhook.SendMessage(WebhookUrl, "closed");
+    DiscordESPResponse closed = client.Webhook.SendMessage(WebhookUrl, "closed");
+    HOST_CHECK(closed.errorCode == DiscordESPResponseCode::Success && !closed.connectionReused);
+    HOST_CHECK(FakeServer::GetConnectCount() == 4);
+    HOST_CHECK(FakeServer::GetRequests().back().GetHeader("Connection") == "close");
+
+    // No Wi-Fi: nothing goes out
+    WiFi.SetStatus(WL_DISCONNECTED);
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "offline").errorCode == DiscordESPResponseCode::WifiNotConnected);
+    WiFi.SetStatus(WL_CONNECTED);
+    HOST_CHECK(FakeServer::GetRequests().size() == 7);
+}
+
+static void Resend()
+{
+    FakeServer::Reset();
+    DiscordESPClient client;
+    client.Setup();
+    FakeServer::Reply(Ok());
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "open").errorCode == DiscordESPResponseCode::Success);
+
+    // The server reset the idle connection: nothing got out, so even a POST goes again
+    FakeServer::ResetIdleConnections();
+    FakeServer::Reply(Ok());
+    DiscordESPResponse reset = client.Webhook.SendMessage(WebhookUrl, "after reset");
+    HOST_CHECK(reset.errorCode == DiscordESPResponseCode::Success && !reset.connectionReused);
+    HOST_CHECK(FakeServer::GetConnectCount() == 2);
+    HOST_CHECK(FakeServer::GetRequests().size() == 2 && FakeServer::GetRequests().back().connection == 1);
+
+    // Closed after the request went out: the server may have posted the message, so a POST fails
+    FakeServer::Drop();
+    FakeServer::Reply(Ok());
+    DiscordESPResponse dropped = client.Webhook.SendMessage(WebhookUrl, "dropped");
+    HOST_CHECK(dropped.errorCode == DiscordESPResponseCode::HttpConnectionLost);
+    HOST_CHECK(FakeServer::GetRequests().size() == 3 && FakeServer::GetPendingReplyCount() == 1);
+
+    // The next request gets the reply queued for the dropped one
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "reconnect").errorCode == DiscordESPResponseCode::Success);
+
+    // A PUT, which is idempotent, goes again on a new connection
+    HOST_CHECK(FakeServer::GetPendingReplyCount() == 0);
+    FakeServer::Drop();
+    FakeServer::Reply(FakeServer::JsonResponse(204, ""));
+    DiscordESPResponse reaction = client.Bot.AddReaction(Token, "42", "7", "x");
+    HOST_CHECK(reaction.errorCode == DiscordESPResponseCode::NoContent && !reaction.connectionReused);
+    const std::vector<FakeRequest> &requests = FakeServer::GetRequests();
+    HOST_CHECK(requests.size() == 6 && FakeServer::GetConnectCount() == 4);
+    if (requests.size() == 6)
+    {
+        HOST_CHECK(requests[4].method == "PUT" && requests[5].method == "PUT");
+        HOST_CHECK(requests[4].path == requests[5].path && requests[4].connection != requests[5].connection);
+    }
+
+    // The same for a queued request
+    FakeServer::Drop();
+    FakeServer::Reply(FakeServer::JsonResponse(204, ""));
+    DiscordESPResponseCode queued = DiscordESPResponseCode::UnknownError;
+    client.Bot.AddReactionAsync(Token, "42", "7", "y", [&queued](DiscordESPResponse &response) { queued = response.errorCode; });
+    DrainQueue(client);
+    HOST_CHECK(queued == DiscordESPResponseCode::NoContent);
+    HOST_CHECK(FakeServer::GetRequests().size() == 8 && FakeServer::GetConnectCount() == 5);
+
+    // No answer at all: the request times out
+    unsigned long start = millis();
+    DiscordESPResponse silent = client.Webhook.SendMessage(WebhookUrl, "silent");
+    HOST_CHECK(silent.errorCode == DiscordESPResponseCode::HttpReadTimeout);
+    HOST_CHECK(millis() - start >= DISCORD_ESP_ASYNC_TIMEOUT_MS);
+
+    FakeServer::RefuseConnections(true);
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "refused").errorCode == DiscordESPResponseCode::HttpConnectionFailed);
+    FakeServer::RefuseConnections(false);
+}
+
+static void AsyncQueue()
+{
+    FakeServer::Reset();
+    DiscordESPClient client;
+    client.Setup();
+    std::vector<int> completed;
+    auto record = [&completed](int id) {
+        return [&completed, id](DiscordESPResponse &response) {
+            HOST_CHECK(response.errorCode == DiscordESPResponseCode::Success);
+            completed.push_back(id);
+        };
+    };
+
+    for (int i = 0; i < DISCORD_ESP_ASYNC_QUEUE_SIZE - 1; i++)
+    {
+        FakeServer::Reply(Ok(), 50);
+        HOST_CHECK(client.Webhook.SendMessageAsync(WebhookUrl, "queued", record(i)).errorCode == DiscordESPResponseCode::Queued);
+    }
+    FakeServer::Reply(Ok(), 50);
+    DiscordESPResponse last = client.Webhook.SendMessageAsync(WebhookUrl, "last", [&client, &completed, record](DiscordESPResponse &) {
+        completed.push_back(DISCORD_ESP_ASYNC_QUEUE_SIZE - 1);
+        client.Webhook.SendMessageAsync(WebhookUrl, "chained", record(DISCORD_ESP_ASYNC_QUEUE_SIZE));
+    });
+    HOST_CHECK(last.errorCode == DiscordESPResponseCode::Queued);
+    HOST_CHECK(client.Webhook.SendMessageAsync(WebhookUrl, "full").errorCode == DiscordESPResponseCode::AsyncQueueFull);
+    HOST_CHECK(client.GetQueuedCount() == DISCORD_ESP_ASYNC_QUEUE_SIZE);
+    HOST_CHECK(FakeServer::GetRequests().empty());
+
+    // Loop() sends the first request and returns without waiting for its response
+    unsigned long start = millis();
+    client.Loop();
+    HOST_CHECK(millis() == start);
+    HOST_CHECK(FakeServer::GetRequests().size() == 1 && completed.empty());
+    client.Loop();
+    HOST_CHECK(FakeServer::GetRequests().size() == 1 && completed.empty());
+
+    // The last callback queues one more request
+    FakeServer::Reply(Ok(), 50);
+    DrainQueue(client);
+    HOST_CHECK(completed.size() == DISCORD_ESP_ASYNC_QUEUE_SIZE + 1);
+    for (size_t i = 0; i < completed.size(); i++)
+        HOST_CHECK(completed[i] == static_cast<int>(i));
+    // One connection for all of them, each request sent once its predecessor was answered
+    const std::vector<FakeRequest> &requests = FakeServer::GetRequests();
+    HOST_CHECK(requests.size() == DISCORD_ESP_ASYNC_QUEUE_SIZE + 1 && FakeServer::GetConnectCount() == 1);
+    HOST_CHECK(millis() - start >= 50 * (DISCORD_ESP_ASYNC_QUEUE_SIZE + 1));
+    HOST_CHECK(requests.back().body == "{\"content\":\"chained\"}");
+}
+
+static void BlockingBehindAsync()
+{
+    FakeServer::Reset();
+    DiscordESPClient client;
+    client.Setup();
+    String delivered;
+    FakeServer::Reply(Ok("{\"id\":\"async\"}"), 100);
+    client.Webhook.SendMessageAsync(WebhookUrl, "async", [&delivered](DiscordESPResponse &response) { delivered = response.responseData[F("id")].as<String>(); });
+    client.Loop();
+    HOST_CHECK(FakeServer::GetRequests().size() == 1);
+
+    // The blocking request waits for the response in flight, but leaves its callback to Loop()
+    FakeServer::Reply(Ok("{\"id\":\"blocking\"}"));
+    unsigned long start = millis();
+    DiscordESPResponse blocking = client.Webhook.SendMessage(WebhookUrl, "blocking");
+    HOST_CHECK(blocking.errorCode == DiscordESPResponseCode::Success && blocking.responseData[F("id")].as<String>() == "blocking");
+    HOST_CHECK(millis() - start >= 100);
+    HOST_CHECK(delivered.isEmpty() && client.GetQueuedCount() == 1);
+    client.Loop();
+    HOST_CHECK(delivered == "async" && client.GetQueuedCount() == 0);
+    HOST_CHECK(FakeServer::GetRequests().size() == 2 && FakeServer::GetConnectCount() == 1);
+}
+
+static void RateLimits()
+{
+    FakeServer::Reset();
+    DiscordESPClient client;
+    client.Setup();
+    const char *exhausted = "X-RateLimit-Bucket: b\r\nX-RateLimit-Limit: 5\r\nX-RateLimit-Remaining: 0\r\nX-RateLimit-Reset-After: 1.5\r\n";
+
+    // The response says the bucket is empty for 1.5 s: the next request waits for it
+    FakeServer::Reply(Ok("{}", exhausted));
+    FakeServer::Reply(Ok());
+    DiscordESPResponse first = client.Webhook.SendMessage(WebhookUrl, "first");
+    HOST_CHECK(first.errorCode == DiscordESPResponseCode::Success);
+    HOST_CHECK(first.rateLimitRemaining == 0 && first.rateLimitResetInMs == 1500);
+    unsigned long start = millis();
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "waited").errorCode == DiscordESPResponseCode::Success);
+    HOST_CHECK(millis() - start >= 1500);
+    HOST_CHECK(FakeServer::GetRequests().size() == 2);
+
+    // Rejected instead when the wait is longer than allowed, or under the Reject policy
+    FakeServer::Reply(Ok("{}", exhausted));
+    client.Webhook.SendMessage(WebhookUrl, "exhaust");
+    client.SetRateLimitPolicy(DiscordRateLimitPolicy::Wait, 1000);
+    DiscordESPResponse tooLong = client.Webhook.SendMessage(WebhookUrl, "too long");
+    HOST_CHECK(tooLong.errorCode == DiscordESPResponseCode::LocalRateLimited && tooLong.rateLimitResetInMs == 1500);
+    client.SetRateLimitPolicy(DiscordRateLimitPolicy::Reject);
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "rejected").errorCode == DiscordESPResponseCode::LocalRateLimited);
+    HOST_CHECK(FakeServer::GetRequests().size() == 3);
+    // Other routes are not affected
+    FakeServer::Reply(Ok());
+    HOST_CHECK(client.Bot.SendMessage(Token, "42", "other").errorCode == DiscordESPResponseCode::Success);
+
+    // A queued request stays queued without blocking Loop() until the bucket resets
+    client.SetRateLimitPolicy(DiscordRateLimitPolicy::Wait);
+    FakeServer::Reply(Ok());
+    bool sent = false;
+    client.Webhook.SendMessageAsync(WebhookUrl, "queued", [&sent](DiscordESPResponse &response) { sent = response.errorCode == DiscordESPResponseCode::Success; });
+    start = millis();
+    client.Loop();
+    HOST_CHECK(millis() == start && FakeServer::GetRequests().size() == 4);
+    DrainQueue(client);
+    HOST_CHECK(sent && millis() - start >= 1500 - 1);
+    HOST_CHECK(FakeServer::GetRequests().size() == 5);
+
+    // Discord answering 429
+    FakeServer::Reply(FakeServer::JsonResponse(429, "{\"message\":\"You are being rate limited.\",\"retry_after\":2,\"global\":false}", "X-RateLimit-Bucket: b\r\nX-RateLimit-Remaining: 0\r\nX-RateLimit-Reset-After: 2\r\nRetry-After: 2\r\nX-RateLimit-Scope: user\r\n"));
+    DiscordESPResponse limited = client.Webhook.SendMessage(WebhookUrl, "limited");
+    HOST_CHECK(limited.errorCode == DiscordESPResponseCode::RateLimitExceeded && limited.rateLimitResetInMs == 2000);
+    client.SetRateLimitPolicy(DiscordRateLimitPolicy::Reject);
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "again").errorCode == DiscordESPResponseCode::LocalRateLimited);
+    delay(2000);
+    FakeServer::Reply(Ok());
+    HOST_CHECK(client.Webhook.SendMessage(WebhookUrl, "after reset").errorCode == DiscordESPResponseCode::Success);
+}
+
+int main()
+{
+    VirtualClock::Install(0);
+    KeepAlive();
+    Resend();
+    AsyncQueue();
+    BlockingBehindAsync();
+    RateLimits();
+    return HostCheckResult();
+}
@@ -0,0 +1,82 @@
+// Runs a million scheduled events through each dispatcher backend on VirtualClock and reports
+// the throughput: repeating timers with mixed periods, plus one-shot tasks that re-dispatch
+// themselves with pseudo-random delays and cancel one another, as timeouts do.
+//
+//     DispatcherBenchmark [events]
+
+#include <Arduino.h>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include "MainThreadDispatcher.hpp"
+
+static constexpr size_t RepeatingTimers = 1000;
+static constexpr size_t OneShotTimers = 1000;
+
+template <typename Dispatcher>
+struct Workload
+{
+    static inline uint64_t events = 0;
+    static inline uint32_t random = 1;
+    static inline TaskHandle handles[OneShotTimers];
+
+    // Deterministic, so every backend runs the same schedule
+    static uint32_t Next()
+    {
+        random = random * 1664525u + 1013904223u;
+        return random >> 8;
+    }
+
+    static void OneShot(size_t slot)
+    {
+        events++;
+        // Every eighth run cancels another pending one-shot, which is then started again
+        if (Next() % 8 == 0)
+        {
+            size_t victim = Next() % OneShotTimers;
+            if (victim != slot && Dispatcher::Cancel(handles[victim]))
+                Start(victim);
+        }
+        Start(slot);
+    }
+
+    static void Start(size_t slot)
+    {
+        handles[slot] = Dispatcher::Dispatch([slot] { OneShot(slot); }, 1 + Next() % 500);
+    }
+
+    static double Run(const char *name, uint64_t target)
+    {
+        VirtualClock::Install(1000000);
+        events = 0;
+        random = 1;
+        for (size_t i = 0; i < RepeatingTimers; i++)
+            Dispatcher::DispatchRepeating([] { events++; }, 10 + i % 990);
+        for (size_t i = 0; i < OneShotTimers; i++)
+            Start(i);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t loops = 0;
+        while (events < target)
+        {
+            Dispatcher::Loop();
+            loops++;
+            uint64_t wait = Dispatcher::TimeUntilNextTaskMicros();
+            if (wait != 0 && wait != UINT64_MAX)
+                VirtualClock::Advance(wait);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-22s %10" PRIu64 " events %8" PRIu64 " loops %8.3f s %12.0f events/s  %6.1f simulated min\n", name, events, loops, seconds, events / seconds, VirtualClock::Now() / 60e6);
+        return events / seconds;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    uint64_t target = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    Workload<BasicMainThreadDispatcher<0, 24, false>>::Run("heap", target);
+    Workload<BasicMainThreadDispatcher<0, 24, true>>::Run("timing wheel", target);
+    Workload<BasicMainThreadDispatcher<4096, 24, false>>::Run("heap, fixed capacity", target);
+    Workload<BasicMainThreadDispatcher<4096, 24, true>>::Run("wheel, fixed capacity", target);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Coroutine tasks on the dispatcher, built as C++20: delays, awaited futures (resolved, rejected
+// and invalid), WaitUntil() polls, and frames going back to the pool once a coroutine finishes.
+
+#include <Arduino.h>
+#include <vector>
+#include "HostCheck.hpp"
+#include "MainThreadDispatcher.hpp"
+
+#ifndef MAIN_THREAD_DISPATCHER_HAS_COROUTINES
+#error "DispatcherCoroutineTest must be built as C++20"
+#endif
+
+using Dispatcher = BasicMainThreadDispatcher<8, 48, false>;
+using Task = Dispatcher::Task;
+
+struct Step
+{
+    int id;
+    unsigned long atMs;
+};
+
+static std::vector<Step> steps;
+static unsigned long startMs = 0;
+
+static void Record(int id) { steps.push_back({id, millis() - startMs}); }
+
+static void RunFor(unsigned long ms)
+{
+    unsigned long start = millis();
+    while (millis() - start < ms)
+        Dispatcher::LoopAndSleep(0, 1);
+}
+
+static void Reset()
+{
+    steps.clear();
+    startMs = millis();
+}
+
+static Task Delays()
+{
+    Record(0);
+    co_await Task::Delay(100);
+    Record(1);
+    co_await Task::Delay(250);
+    Record(2);
+}
+
+static Task AwaitFutures(Dispatcher::Promise<int> pending, Dispatcher::Promise<int> rejected)
+{
+    std::optional<int> ready = co_await Dispatcher::DispatchWithResult([] { return 7; }, 50);
+    Record(ready && *ready == 7 ? 10 : -10);
+    std::optional<int> later = co_await pending.GetFuture();
+    Record(later && *later == 8 ? 11 : -11);
+    std::optional<int> failed = co_await rejected.GetFuture();
+    Record(failed ? -12 : 12);
+    std::optional<int> invalid = co_await Dispatcher::Future<int>();
+    Record(invalid ? -13 : 13);
+}
+
+static Task WaitForFlag(const bool *flag)
+{
+    co_await Task::WaitUntil([flag] { return *flag; }, 20);
+    Record(20);
+}
+
+static Task Suspended()
+{
+    co_await Task::Delay(1000);
+}
+
+static void CheckSteps(const std::vector<Step> &expected)
+{
+    HOST_CHECK(steps.size() == expected.size());
+    for (size_t i = 0; i < steps.size() && i < expected.size(); i++)
+    {
+        HOST_CHECK(steps[i].id == expected[i].id);
+        HOST_CHECK(steps[i].atMs == expected[i].atMs);
+    }
+}
+
+int main()
+{
+    VirtualClock::Install(0);
+
+    {
+        Reset();
+        HOST_CHECK(Delays().IsValid());
+        HOST_CHECK(CoroutineFramePool::GetUsedCount() == 1);
+        RunFor(400);
+        CheckSteps({{0, 0}, {1, 100}, {2, 350}});
+        HOST_CHECK(CoroutineFramePool::GetUsedCount() == 0);
+    }
+
+    {
+        Reset();
+        Dispatcher::Promise<int> pending;
+        Dispatcher::Promise<int> rejected;
+        HOST_CHECK(AwaitFutures(pending, rejected).IsValid());
+        RunFor(100);
+        CheckSteps({{10, 50}});
+        pending.SetValue(8);
+        RunFor(10);
+        // Rejection resumes the coroutine from Reject() itself, and the invalid future right away
+        rejected.Reject();
+        CheckSteps({{10, 50}, {11, 100}, {12, 110}, {13, 110}});
+        HOST_CHECK(CoroutineFramePool::GetUsedCount() == 0);
+    }
+
+    {
+        Reset();
+        bool flag = false;
+        HOST_CHECK(WaitForFlag(&flag).IsValid());
+        RunFor(50);
+        flag = true;
+        RunFor(50);
+        // Polled at 20, 40 and 60 ms
+        CheckSteps({{20, 60}});
+        HOST_CHECK(CoroutineFramePool::GetUsedCount() == 0);
+    }
+
+    {
+        // Every frame in use: the next coroutine does not start
+        for (int i = 0; i < MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES; i++)
+            HOST_CHECK(Suspended().IsValid());
+        HOST_CHECK(CoroutineFramePool::GetUsedCount() == MAIN_THREAD_DISPATCHER_COROUTINE_FRAMES);
+        uint32_t failed = CoroutineFramePool::GetFailedCount();
+        HOST_CHECK(!Suspended().IsValid());
+        HOST_CHECK(CoroutineFramePool::GetFailedCount() == failed + 1);
+        RunFor(1001);
+        HOST_CHECK(CoroutineFramePool::GetUsedCount() == 0);
+        HOST_CHECK(Suspended().IsValid());
+        RunFor(1001);
+    }
+
+    HOST_CHECK(CoroutineFramePool::GetUsedCount() == 0);
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+    return HostCheckResult();
+}
@@ -0,0 +1,149 @@
+// Futures chained with Then(): values flow down the chain, flattened futures are awaited, and a
+// step that cannot get a state or a dispatcher slot fails the chain instead of dropping it.
+
+#include <Arduino.h>
+#include "HostCheck.hpp"
+#include "MainThreadDispatcher.hpp"
+
+// Four task slots, so the tests can fill the dispatcher
+using Dispatcher = BasicMainThreadDispatcher<4, 48, false>;
+
+template <typename T>
+using Future = Dispatcher::Future<T>;
+template <typename T>
+using Promise = Dispatcher::Promise<T>;
+
+static void RunFor(unsigned long ms)
+{
+    unsigned long start = millis();
+    while (millis() - start < ms)
+        Dispatcher::LoopAndSleep(0, 1);
+}
+
+static void Chaining()
+{
+    int seen = 0;
+    Future<int> doubled = Dispatcher::DispatchWithResult([] { return 21; }).Then([](int value) { return value * 2; });
+    Future<void> done = doubled.Then([&seen](int value) { seen = value; });
+    HOST_CHECK(done.IsValid() && !done.IsReady());
+    RunFor(5);
+    HOST_CHECK(doubled.IsReady() && doubled.Get() == 42);
+    HOST_CHECK(done.IsReady() && !done.IsFailed());
+    HOST_CHECK(seen == 42);
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+}
+
+static void Flattening()
+{
+    {
+        // The inner future resolves 100 ms later; the chain waits for it
+        Future<int> flattened = Dispatcher::DispatchWithResult([] { return 5; }).Then([](int value) {
+            return Dispatcher::DispatchWithResult([value] { return value + 1; }, 100);
+        });
+        RunFor(50);
+        HOST_CHECK(flattened.IsValid() && !flattened.IsReady() && !flattened.IsFailed());
+        RunFor(60);
+        HOST_CHECK(flattened.IsReady() && flattened.Get() == 6);
+    }
+    {
+        // Returning an invalid future fails the chain
+        Future<int> invalid = Dispatcher::DispatchWithResult([] { return 1; }).Then([](int) { return Future<int>(); });
+        RunFor(5);
+        HOST_CHECK(invalid.IsFailed() && !invalid.IsReady());
+    }
+    {
+        // So does a returned future rejected later
+        Promise<int> promise;
+        Future<int> rejected = Dispatcher::DispatchWithResult([] { return 1; }).Then([promise](int) { return promise.GetFuture(); });
+        RunFor(5);
+        HOST_CHECK(rejected.IsValid() && !rejected.IsFailed());
+        promise.Reject();
+        HOST_CHECK(rejected.IsFailed() && !rejected.IsReady());
+    }
+}
+
+static void Rejection()
+{
+    bool ran = false;
+    Promise<int> promise;
+    Future<int> first = promise.GetFuture().Then([&ran](int value) {
+        ran = true;
+        return value;
+    });
+    Future<void> second = first.Then([&ran](int) { ran = true; });
+    promise.Reject();
+    HOST_CHECK(first.IsFailed() && second.IsFailed());
+    // Attaching to an already rejected future rejects right away
+    HOST_CHECK(second.Then([&ran] { ran = true; }).IsFailed());
+    promise.SetValue(1);
+    RunFor(5);
+    HOST_CHECK(!ran && !first.IsReady());
+}
+
+static void PoolExhaustion()
+{
+    // MAIN_THREAD_DISPATCHER_FUTURE_POOL_SIZE states of long, all held
+    Promise<long> held[MAIN_THREAD_DISPATCHER_FUTURE_POOL_SIZE];
+    for (Promise<long> &promise : held)
+        HOST_CHECK(promise.IsValid());
+    HOST_CHECK(!Promise<long>().IsValid());
+    HOST_CHECK(!Dispatcher::DispatchWithResult([] { return 1L; }).IsValid());
+
+    // No state for the next step: Then() reports it to the caller
+    bool ran = false;
+    Promise<int> source;
+    Future<long> next = source.GetFuture().Then([&ran](int value) {
+        ran = true;
+        return static_cast<long>(value);
+    });
+    HOST_CHECK(!next.IsValid());
+
+    // No state for the future a flattened step's result is forwarded to
+    Future<long> flattened = source.GetFuture().Then([](int) { return Future<long>(); });
+    HOST_CHECK(!flattened.IsValid());
+    source.SetValue(1);
+    RunFor(5);
+    HOST_CHECK(!ran);
+}
+
+static void DispatcherFull()
+{
+    bool ran = false;
+    Promise<int> promise;
+    Future<int> first = promise.GetFuture().Then([&ran](int value) {
+        ran = true;
+        return value;
+    });
+    Future<void> second = first.Then([&ran](int) { ran = true; });
+
+    // No slot left for the continuation when the value arrives
+    TaskHandle fillers[4];
+    for (TaskHandle &filler : fillers)
+        filler = Dispatcher::Dispatch([] { }, 1000);
+    HOST_CHECK(Dispatcher::GetPendingCount() == 4);
+    promise.SetValue(7);
+    HOST_CHECK(first.IsFailed() && second.IsFailed());
+
+    // Same when the value is already there as the continuation is attached
+    Promise<int> resolved;
+    resolved.SetValue(8);
+    Future<void> late = resolved.GetFuture().Then([&ran](int) { ran = true; });
+    HOST_CHECK(late.IsValid() && late.IsFailed());
+
+    for (TaskHandle &filler : fillers)
+        Dispatcher::Cancel(filler);
+    RunFor(5);
+    HOST_CHECK(!ran);
+    HOST_CHECK(promise.GetFuture().IsReady() && promise.GetFuture().Get() == 7);
+}
+
+int main()
+{
+    VirtualClock::Install(0);
+    Chaining();
+    Flattening();
+    Rejection();
+    PoolExhaustion();
+    DispatcherFull();
+    return HostCheckResult();
+}
@@ -0,0 +1,206 @@
+// Reproductions of dispatcher bugs, one block per bug, on VirtualClock.
+
+#include <Arduino.h>
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include "HostCheck.hpp"
+#include "MainThreadDispatcher.hpp"
+
+template <typename Dispatcher>
+static void RateLaneReusesCancelledSlot()
+{
+    // A rate-limited task placed in the slot of a cancelled timer must not be run by the
+    // cancelled timer's tombstone before the lane releases it
+    static int limitedRuns = 0;
+    static int cancelledRuns = 0;
+    limitedRuns = 0;
+    cancelledRuns = 0;
+    HOST_CHECK(Dispatcher::ConfigureRateLane(0, 0.001f, 1, 4));
+    // Spend the lane's only token
+    Dispatcher::DispatchRateLimited(0, [] { limitedRuns++; });
+    Dispatcher::Loop();
+    HOST_CHECK(limitedRuns == 1);
+
+    TaskHandle cancelled = Dispatcher::Dispatch([] { cancelledRuns++; }, 10);
+    HOST_CHECK(Dispatcher::Cancel(cancelled));
+    TaskHandle limited = Dispatcher::DispatchRateLimited(0, [] { limitedRuns++; });
+    HOST_CHECK(limited.index == cancelled.index);
+    VirtualClock::Advance(20000);
+    Dispatcher::Loop();
+    HOST_CHECK(cancelledRuns == 0);
+    HOST_CHECK(limitedRuns == 1);
+    HOST_CHECK(Dispatcher::IsPending(limited));
+    HOST_CHECK(Dispatcher::GetRateLaneStats(0).depth == 1);
+
+    HOST_CHECK(Dispatcher::Cancel(limited));
+    HOST_CHECK(Dispatcher::GetRateLaneStats(0).depth == 0);
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+}
+
+template <typename Dispatcher>
+static void SleepWakesAtDeadline(bool timingWheel)
+{
+    // LoopAndSleep() must wake exactly when the next task is due, never past it. The timing
+    // wheel may wake early to turn a higher level, then sleeps the rest.
+    static uint64_t ranAt = 0;
+    constexpr unsigned long maxSleepMs = 100000;
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+
+    // No work: sleep the maximum
+    HOST_CHECK(Dispatcher::TimeUntilNextTask() == ULONG_MAX);
+    uint64_t start = VirtualClock::Now();
+    Dispatcher::LoopAndSleep(0, maxSleepMs);
+    HOST_CHECK(VirtualClock::Now() - start == maxSleepMs * 1000);
+
+    // An ISR dispatch waiting in the ring is work for right now
+    Dispatcher::DispatchFromISR([] {});
+    HOST_CHECK(Dispatcher::TimeUntilNextTask() == 0);
+    Dispatcher::Loop();
+
+    // Deadlines on each level of the wheel
+    for (long delayMs : {7L, 250L, 5000L, 90000L})
+    {
+        ranAt = 0;
+        start = VirtualClock::Now();
+        Dispatcher::Dispatch([] { ranAt = VirtualClock::Now(); }, delayMs);
+        HOST_CHECK(Dispatcher::TimeUntilNextTask() <= static_cast<unsigned long>(delayMs));
+        int sleeps = 0;
+        while (ranAt == 0 && sleeps < 8)
+        {
+            Dispatcher::LoopAndSleep(0, maxSleepMs);
+            sleeps++;
+        }
+        HOST_CHECK(ranAt - start == static_cast<uint64_t>(delayMs) * 1000);
+        // The heap knows the deadline: one sleep, then the Loop() that runs the task
+        if (!timingWheel)
+            HOST_CHECK(sleeps == 2);
+    }
+
+    // A rate lane waiting for its next token: 4 per second, no burst
+    HOST_CHECK(Dispatcher::ConfigureRateLane(1, 4, 1, 4));
+    static uint64_t releasedAt[3];
+    static int released = 0;
+    released = 0;
+    start = VirtualClock::Now();
+    for (int i = 0; i < 3; i++)
+        Dispatcher::DispatchRateLimited(1, [] { releasedAt[released++] = VirtualClock::Now(); });
+    int sleeps = 0;
+    while (released < 3 && sleeps < 8)
+    {
+        Dispatcher::LoopAndSleep(0, maxSleepMs);
+        sleeps++;
+    }
+    HOST_CHECK(released == 3);
+    HOST_CHECK(releasedAt[0] == start);
+    HOST_CHECK(releasedAt[1] - start == 250000);
+    HOST_CHECK(releasedAt[2] - start == 500000);
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+}
+
+template <typename Dispatcher>
+static void CatchesUpAcrossLongGaps()
+{
+    // The timing wheel jumps from one occupied slot to the next instead of turning through
+    // empty ones. After clock jumps of up to three hours, every task due must run in deadline
+    // order, and nothing early, past the wheel's 4.6 hour range too.
+    struct Run
+    {
+        uint32_t id;
+        uint64_t atUs;
+    };
+    static std::vector<Run> runs;
+    runs.clear();
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+
+    constexpr uint32_t tasks = 400;
+    uint64_t start = VirtualClock::Now();
+    uint64_t dueUs[tasks];
+    uint32_t random = 7;
+    auto next = [&random] {
+        random = random * 1664525u + 1013904223u;
+        return random >> 8;
+    };
+    uint64_t startMs = start / 1000;
+    for (uint32_t id = 0; id < tasks; id++)
+    {
+        // Up to 8 hours, plus deadlines on the first tick of level 1 and 2 slots and on the
+        // tick just before, where the wheel enters a slot right after expiring one
+        uint64_t dueMs;
+        if (id % 4 == 0)
+            dueMs = startMs + 1 + next() % (8 * 3600000UL);
+        else if (id % 4 == 1)
+            dueMs = (startMs / 64 + 1 + next() % 1000) * 64;
+        else if (id % 4 == 2)
+            dueMs = (startMs / 4096 + 1 + next() % 400) * 4096;
+        else
+            dueMs = dueUs[id - 1 - next() % 2] / 1000 - 1;
+        dueUs[id] = dueMs * 1000;
+        Dispatcher::Dispatch([id] { runs.push_back({id, VirtualClock::Now()}); }, static_cast<long>(dueMs - startMs));
+    }
+
+    while (Dispatcher::GetPendingCount() > 0)
+    {
+        VirtualClock::Advance((1 + next() % (3 * 3600)) * 1000ULL * (next() % 4 == 0 ? 1000 : 1));
+        size_t before = runs.size();
+        while (Dispatcher::Loop() > 0)
+        {
+        }
+        for (uint32_t id = 0; id < tasks; id++)
+        {
+            bool ran = std::any_of(runs.begin(), runs.end(), [id](const Run &run) { return run.id == id; });
+            HOST_CHECK(ran == (dueUs[id] <= VirtualClock::Now()));
+        }
+        for (size_t i = before; i < runs.size(); i++)
+            HOST_CHECK(runs[i].atUs == VirtualClock::Now());
+    }
+    HOST_CHECK(runs.size() == tasks);
+    for (size_t i = 1; i < runs.size(); i++)
+        HOST_CHECK(dueUs[runs[i - 1].id] < dueUs[runs[i].id] || (dueUs[runs[i - 1].id] == dueUs[runs[i].id] && runs[i - 1].id < runs[i].id));
+}
+
+// Left with pending tasks until exit. Built before main(), so before the dispatcher's slots,
+// which are then destroyed first.
+template <typename Dispatcher>
+static typename Dispatcher::TaskGroup exitGroup;
+
+template <typename Dispatcher>
+static void TaskGroupLifetimes()
+{
+    static int runs = 0;
+    runs = 0;
+    size_t pending = Dispatcher::GetPendingCount();
+    {
+        // Destroying a group cancels its tasks, repeating ones included
+        typename Dispatcher::TaskGroup group;
+        Dispatcher::Dispatch(group, [] { runs++; }, 10);
+        HOST_CHECK(Dispatcher::AddToGroup(Dispatcher::DispatchRepeating([] { runs++; }, 10), group));
+        HOST_CHECK(group.GetCount() == 2);
+    }
+    HOST_CHECK(Dispatcher::GetPendingCount() == pending);
+    VirtualClock::Advance(20000);
+    Dispatcher::Loop();
+    HOST_CHECK(runs == 0);
+
+    // The group outlives the slots: its destructor must not touch them (checked by ASan at exit)
+    Dispatcher::Dispatch(exitGroup<Dispatcher>, [] { runs++; }, 60000);
+    HOST_CHECK(Dispatcher::AddToGroup(Dispatcher::DispatchRepeating([] { runs++; }, 1000), exitGroup<Dispatcher>));
+    HOST_CHECK(exitGroup<Dispatcher>.GetCount() == 2);
+}
+
+int main()
+{
+    VirtualClock::Install(1000000);
+    RateLaneReusesCancelledSlot<BasicMainThreadDispatcher<0, 24, false>>();
+    RateLaneReusesCancelledSlot<BasicMainThreadDispatcher<0, 24, true>>();
+    RateLaneReusesCancelledSlot<BasicMainThreadDispatcher<16, 24, false>>();
+    SleepWakesAtDeadline<BasicMainThreadDispatcher<0, 24, false>>(false);
+    SleepWakesAtDeadline<BasicMainThreadDispatcher<0, 24, true>>(true);
+    SleepWakesAtDeadline<BasicMainThreadDispatcher<16, 24, false>>(false);
+    CatchesUpAcrossLongGaps<BasicMainThreadDispatcher<0, 24, false>>();
+    CatchesUpAcrossLongGaps<BasicMainThreadDispatcher<0, 24, true>>();
+    TaskGroupLifetimes<BasicMainThreadDispatcher<0, 24, false>>();
+    TaskGroupLifetimes<BasicMainThreadDispatcher<0, 24, true>>();
+    TaskGroupLifetimes<BasicMainThreadDispatcher<16, 24, false>>();
+    return HostCheckResult();
+}
@@ -0,0 +1,104 @@
+// Replays one day of a typical firmware schedule on VirtualClock: sensor sampling, periodic
+// reports, coalesced state flushes, rate-limited API calls, interrupt events and session
+// timeouts cancelled as a group. Every count is deterministic, so any scheduling change that
+// moves a task shows up as a failed check.
+
+#include <Arduino.h>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include "HostCheck.hpp"
+#include "MainThreadDispatcher.hpp"
+
+using Dispatcher = MainThreadDispatcher;
+
+static constexpr uint64_t DayUs = 24ULL * 3600 * 1000000;
+
+static uint32_t samples = 0;
+static uint32_t reports = 0;
+static uint32_t flushes = 0;
+static uint32_t apiCalls = 0;
+static uint32_t interrupts = 0;
+static uint32_t sessionTimeouts = 0;
+static uint32_t sessions = 0;
+static uint32_t sessionCancels = 0;
+static uint64_t burstStart = 0;
+static uint64_t minBurstSpan = UINT64_MAX;
+static Dispatcher::TaskGroup session;
+
+static void onInterrupt() { interrupts++; }
+
+static void sample()
+{
+    samples++;
+    // A GPIO interrupt every 10 samples, going through the ISR ring
+    if (samples % 10 == 0)
+        Dispatcher::DispatchFromISR(onInterrupt);
+    // State changes flushed at most every 5 s
+    Dispatcher::DispatchCoalesced(1, [] { flushes++; }, 5000, CoalescePolicy::ThrottleTrailing);
+}
+
+static void report()
+{
+    reports++;
+    // Building the report takes 20 ms
+    VirtualClock::Advance(20000);
+    // Ten API calls per report, smoothed by rate lane 0
+    for (int i = 0; i < 10; i++)
+    {
+        Dispatcher::DispatchRateLimited(0, [] {
+            // Time from the first to the last call of each report's ten
+            uint64_t now = VirtualClock::Now();
+            if (apiCalls % 10 == 0)
+                burstStart = now;
+            else if (apiCalls % 10 == 9 && now - burstStart < minBurstSpan)
+                minBurstSpan = now - burstStart;
+            apiCalls++;
+        });
+    }
+}
+
+static void startSession()
+{
+    // Per-peer timeouts of a chat session, abandoned after 30 min
+    sessions++;
+    for (int i = 0; i < 20; i++)
+        Dispatcher::Dispatch(session, [] { sessionTimeouts++; }, 3600000L + i * 1000L);
+    Dispatcher::Dispatch([] { sessionCancels += Dispatcher::CancelGroup(session); }, 1800000L);
+}
+
+int main()
+{
+    VirtualClock::Install(1000000);
+    Dispatcher::ConfigureRateLane(0, 2.0f, 3, 16);
+    Dispatcher::DispatchRepeating(sample, 1000);
+    Dispatcher::DispatchRepeating(report, 60000, RepeatMode::FixedDelay);
+    Dispatcher::DispatchRepeating(startSession, 3600000);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t loops = VirtualClock::RunFor<Dispatcher>(DayUs);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("simulated 24 h in %.3f s, %zu Loop() calls\n", seconds, loops);
+    std::printf("samples %" PRIu32 ", reports %" PRIu32 ", flushes %" PRIu32 ", api calls %" PRIu32 ", interrupts %" PRIu32 ", session timeouts %" PRIu32 "\n", samples, reports, flushes, apiCalls, interrupts, sessionTimeouts);
+    RateLaneStats lane = Dispatcher::GetRateLaneStats(0);
+    std::printf("rate lane: high water %u, dropped %" PRIu32 ", shortest burst %" PRIu64 " us\n", lane.highWater, lane.dropped, minBurstSpan);
+
+    HOST_CHECK(samples == 86400);
+    // FixedDelay: each period starts after the 20 ms the report takes
+    HOST_CHECK(reports == static_cast<uint32_t>(DayUs / 60020000));
+    // One flush per 5 s window, each opened by the first sample after the previous flush
+    HOST_CHECK(flushes >= 86400 / 6 && flushes <= 86400 / 5);
+    HOST_CHECK(interrupts == samples / 10);
+    // Every session is cancelled before its timeouts are due, but the one started as the day ends
+    HOST_CHECK(sessions == 24);
+    HOST_CHECK(sessionTimeouts == 0);
+    HOST_CHECK(sessionCancels == 23 * 20);
+    HOST_CHECK(session.GetCount() == 20);
+    HOST_CHECK(lane.dropped == 0);
+    HOST_CHECK(apiCalls + lane.depth == reports * 10);
+    // All ten wait for the next Loop(), then 3 go out at once and the other 7 at 2 per second
+    HOST_CHECK(lane.highWater == 10);
+    HOST_CHECK(minBurstSpan == 3500000);
+    return HostCheckResult();
+}
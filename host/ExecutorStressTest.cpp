@@ -0,0 +1,116 @@
+// Stress test of WorkStealingExecutor on std::thread workers, built with ThreadSanitizer. Two
+// producer threads submit root jobs with completions; every root fans out into a tree of child
+// jobs submitted from the workers, which land on the workers' own deques and get stolen by the
+// idle ones. Checks that every job runs exactly once, that every completion reaches the main
+// loop once, and that the pool drains. Then checks that workers blocked with nothing to do are
+// woken by a single submission.
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "HostCheck.hpp"
+#include "MainThreadDispatcher.hpp"
+#include "WorkStealingExecutor.hpp"
+
+using Dispatcher = MainThreadDispatcher;
+using Executor = BasicWorkStealingExecutor<Dispatcher, 4, 64>;
+
+static constexpr uint32_t Producers = 2;
+static constexpr uint32_t RootsPerProducer = 500;
+static constexpr uint32_t Roots = Producers * RootsPerProducer;
+// Nodes of the complete binary tree each root expands into
+static constexpr uint32_t TreeSize = 31;
+
+static std::atomic<uint32_t> executed[Roots * TreeSize];
+static std::atomic<uint32_t> ranInline{0};
+// Only touched on the main thread, so TSan reports a completion run anywhere else
+static uint32_t completed[Roots];
+static uint32_t completedTotal = 0;
+
+// Some CPU work, standing in for serialization
+static uint32_t Work(uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (int i = 0; i < 200; i++)
+        hash = (hash ^ static_cast<uint32_t>(i)) * 16777619u;
+    return hash;
+}
+
+static void RunNode(uint32_t root, uint32_t node)
+{
+    executed[root * TreeSize + node]++;
+    Work(node);
+    for (uint32_t child = 2 * node + 1; child <= 2 * node + 2 && child < TreeSize; child++)
+    {
+        // A full pool runs the child inline, as callers of Submit() should
+        if (!Executor::Submit([root, child] { RunNode(root, child); }))
+        {
+            ranInline++;
+            RunNode(root, child);
+        }
+    }
+}
+
+static void Produce(uint32_t producer)
+{
+    for (uint32_t i = 0; i < RootsPerProducer; i++)
+    {
+        uint32_t root = producer * RootsPerProducer + i;
+        // Leave most of the pool to the trees, so the workers' deques fill and get stolen from
+        while (Executor::GetPendingCount() > 8)
+            std::this_thread::yield();
+        while (!Executor::Submit(
+            [root] {
+                RunNode(root, 0);
+                return root;
+            },
+            [](uint32_t done) {
+                completed[done]++;
+                completedTotal++;
+            }))
+            std::this_thread::yield();
+    }
+}
+
+int main()
+{
+    HOST_CHECK(Executor::Start());
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < Producers; producer++)
+        producers.emplace_back(Produce, producer);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(120);
+    while (completedTotal < Roots && std::chrono::steady_clock::now() < deadline)
+        Dispatcher::Loop();
+    for (std::thread &producer : producers)
+        producer.join();
+
+    // Idle workers block without a timeout, so only the submission's wake-up runs this
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool woken = false;
+    HOST_CHECK(Executor::Submit([] { return Work(1); }, [&woken](uint32_t) { woken = true; }));
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!woken && std::chrono::steady_clock::now() < deadline)
+        Dispatcher::Loop();
+    HOST_CHECK(woken);
+
+    Executor::Stop();
+    Dispatcher::Loop();
+
+    std::printf("%u roots, %u jobs stolen, %u submissions rejected, %u children run inline\n", completedTotal, Executor::GetStolenCount(), Executor::GetRejectedCount(), ranInline.load());
+    uint32_t wrongRuns = 0;
+    for (auto &count : executed)
+        wrongRuns += count != 1;
+    uint32_t wrongCompletions = 0;
+    for (uint32_t count : completed)
+        wrongCompletions += count != 1;
+    HOST_CHECK(wrongRuns == 0);
+    HOST_CHECK(wrongCompletions == 0);
+    HOST_CHECK(completedTotal == Roots);
+    HOST_CHECK(Executor::GetPendingCount() == 0);
+    HOST_CHECK(Dispatcher::GetPendingCount() == 0);
+    return HostCheckResult();
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+// Scripted HTTP peer behind the shim's NetworkClient. Tests queue the replies, the client
+// connects and writes as it would to a real server, and each complete request takes the next
+// reply off the queue. Replies become readable after their delay on the virtual clock.
+
+#include <Arduino.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct FakeRequest
+{
+    // Index of the connection it came on, counting from 0 since Reset()
+    size_t connection = 0;
+    String method;
+    String path;
+    std::vector<std::pair<String, String>> headers;
+    String body;
+
+    String GetHeader(const char *name) const
+    {
+        for (const auto &header : headers)
+        {
+            if (header.first.equalsIgnoreCase(name))
+                return header.second;
+        }
+        return String();
+    }
+};
+
+class FakeServer
+{
+public:
+    // One side of an open connection, shared by the client and the server
+    struct Connection
+    {
+        size_t index = 0;
+        String host;
+        uint16_t port = 0;
+        // Bytes from the client not yet parsed into a request
+        std::string received;
+        // Bytes for the client and when they become readable
+        std::string pending;
+        uint64_t readableAtUs = 0;
+        // Closed by the server, after the client has read what is pending
+        bool closed = false;
+        // Reset while idle: the client only finds out on its next write
+        bool reset = false;
+    };
+
+    static void Reset()
+    {
+        _replies().clear();
+        _requests().clear();
+        _connections().clear();
+        _refuse() = false;
+    }
+
+    // Answers the next request with response, after delayMs. closeAfter closes the connection
+    // once the client has read it.
+    static void Reply(const String &response, uint32_t delayMs = 0, bool closeAfter = false) { _replies().push_back({response.c_str(), delayMs, closeAfter, false}); }
+
+    // Reads the next request and closes the connection without answering
+    static void Drop() { _replies().push_back({std::string(), 0, true, true}); }
+
+    static void RefuseConnections(bool refuse) { _refuse() = refuse; }
+
+    // Resets every open connection, as a server dropping idle keep-alive connections does. The
+    // clients still see them as connected until they write.
+    static void ResetIdleConnections()
+    {
+        for (const std::weak_ptr<Connection> &weak : _connections())
+        {
+            std::shared_ptr<Connection> connection = weak.lock();
+            if (connection && !connection->closed)
+                connection->reset = true;
+        }
+    }
+
+    static size_t GetConnectCount() { return _connections().size(); }
+    static size_t GetPendingReplyCount() { return _replies().size(); }
+    static const std::vector<FakeRequest> &GetRequests() { return _requests(); }
+
+    // A response with a JSON body and the given extra header lines, each ending in \r\n
+    static String JsonResponse(int status, const char *json, const char *headers = "")
+    {
+        char head[96];
+        snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\n", status, _reason(status), static_cast<unsigned>(strlen(json)));
+        return String(head) + headers + "\r\n" + json;
+    }
+
+    // The same, with the body sent as two chunks
+    static String ChunkedJsonResponse(int status, const char *json, const char *headers = "")
+    {
+        size_t half = strlen(json) / 2;
+        char head[128];
+        snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n", status, _reason(status));
+        char first[24], second[24];
+        snprintf(first, sizeof(first), "%zx\r\n", half);
+        snprintf(second, sizeof(second), "\r\n%zx\r\n", strlen(json) - half);
+        String response = String(head) + headers + "\r\n" + first;
+        response.concat(json, half);
+        return response + second + (json + half) + "\r\n0\r\n\r\n";
+    }
+
+    // Called by NetworkClient
+
+    static std::shared_ptr<Connection> Connect(const char *host, uint16_t port)
+    {
+        if (_refuse())
+            return nullptr;
+        auto connection = std::make_shared<Connection>();
+        connection->index = _connections().size();
+        connection->host = host;
+        connection->port = port;
+        _connections().push_back(connection);
+        return connection;
+    }
+
+    static void Receive(Connection &connection, const uint8_t *data, size_t size)
+    {
+        connection.received.append(reinterpret_cast<const char *>(data), size);
+        FakeRequest request;
+        while (!connection.closed && _parse(connection, request))
+        {
+            request.connection = connection.index;
+            _requests().push_back(request);
+            _answer(connection);
+        }
+    }
+
+private:
+    struct ScriptedReply
+    {
+        std::string response;
+        uint32_t delayMs;
+        bool closeAfter;
+        bool drop;
+    };
+
+    // Takes one complete request off the front of what was received
+    static bool _parse(Connection &connection, FakeRequest &request)
+    {
+        size_t end = connection.received.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return false;
+        request = FakeRequest();
+        size_t lineEnd = connection.received.find("\r\n");
+        std::string line = connection.received.substr(0, lineEnd);
+        size_t space = line.find(' ');
+        request.method = line.substr(0, space).c_str();
+        request.path = line.substr(space + 1, line.rfind(' ') - space - 1).c_str();
+        size_t contentLength = 0;
+        for (size_t at = lineEnd + 2; at < end;)
+        {
+            size_t next = connection.received.find("\r\n", at);
+            std::string header = connection.received.substr(at, next - at);
+            size_t colon = header.find(':');
+            String name = header.substr(0, colon).c_str();
+            String value = header.substr(colon + 1).c_str();
+            value.trim();
+            if (name.equalsIgnoreCase("Content-Length"))
+                contentLength = value.toInt();
+            request.headers.emplace_back(name, value);
+            at = next + 2;
+        }
+        if (connection.received.size() < end + 4 + contentLength)
+            return false;
+        request.body = connection.received.substr(end + 4, contentLength).c_str();
+        connection.received.erase(0, end + 4 + contentLength);
+        return true;
+    }
+
+    // Without a scripted reply the request is left unanswered and the client times out
+    static void _answer(Connection &connection)
+    {
+        if (_replies().empty())
+            return;
+        ScriptedReply reply = _replies().front();
+        _replies().pop_front();
+        if (reply.drop)
+        {
+            connection.closed = true;
+            return;
+        }
+        connection.pending += reply.response;
+        connection.readableAtUs = MonotonicClock::Micros() + static_cast<uint64_t>(reply.delayMs) * 1000;
+        connection.closed = reply.closeAfter;
+    }
+
+    static const char *_reason(int status)
+    {
+        switch (status)
+        {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        default: return "Status";
+        }
+    }
+
+    static std::deque<ScriptedReply> &_replies()
+    {
+        static std::deque<ScriptedReply> replies;
+        return replies;
+    }
+
+    static std::vector<FakeRequest> &_requests()
+    {
+        static std::vector<FakeRequest> requests;
+        return requests;
+    }
+
+    static std::vector<std::weak_ptr<Connection>> &_connections()
+    {
+        static std::vector<std::weak_ptr<Connection>> connections;
+        return connections;
+    }
+
+    static bool &_refuse()
+    {
+        static bool refuse = false;
+        return refuse;
+    }
+};
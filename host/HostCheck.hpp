@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertion for the host programs: reports the failed condition and carries on, so one
+// run lists every failure. main() returns HostCheckResult().
+inline int &HostCheckFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define HOST_CHECK(condition)                                                         \
+    do                                                                                \
+    {                                                                                 \
+        if (!(condition))                                                             \
+        {                                                                             \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            HostCheckFailures()++;                                                    \
+        }                                                                             \
+    } while (0)
+
+inline int HostCheckResult()
+{
+    if (HostCheckFailures() != 0)
+        std::printf("%d check(s) failed\n", HostCheckFailures());
+    return HostCheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// Measures what one Loop() costs as the number of pending (not yet due) tasks grows, next to
+// the linear scan the dispatcher used before the min-heap. Each iteration dispatches one task
+// due at once and runs Loop(), so exactly one task fires per call.
+//
+//     LoopCostBenchmark [iterations]
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include "MainThreadDispatcher.hpp"
+
+// The original implementation: copies the queue every Loop() and erases fired tasks from it
+class LinearScanDispatcher
+{
+public:
+    static void Loop()
+    {
+        if (_tasks().empty())
+            return;
+        std::vector<Task> currentTasks(_tasks().begin(), _tasks().end());
+        unsigned long currentTime = millis();
+        for (auto it = currentTasks.begin(); it != currentTasks.end();)
+        {
+            if (currentTime - it->scheduledTime < static_cast<unsigned long>(it->delayMs))
+            {
+                ++it;
+                continue;
+            }
+            it->func();
+            auto originalIt = std::find_if(_tasks().begin(), _tasks().end(), [it](const Task &task) { return task.scheduledTime == it->scheduledTime && task.delayMs == it->delayMs; });
+            if (originalIt != _tasks().end())
+                _tasks().erase(originalIt);
+            it = currentTasks.erase(it);
+        }
+    }
+
+    static void Dispatch(std::function<void()> func, long delayMs = 0) { _tasks().push_back({func, delayMs, millis()}); }
+
+    static void Clear() { _tasks().clear(); }
+
+private:
+    struct Task
+    {
+        std::function<void()> func;
+        long delayMs;
+        unsigned long scheduledTime;
+    };
+
+    static std::vector<Task> &_tasks()
+    {
+        static std::vector<Task> instance;
+        return instance;
+    }
+};
+
+static volatile uint32_t fired = 0;
+
+template <typename Dispatcher, typename Setup, typename Teardown>
+static double MeasureNs(size_t pending, size_t iterations, Setup setup, Teardown teardown)
+{
+    for (size_t i = 0; i < pending; i++)
+        setup(i);
+    Dispatcher::Loop();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        Dispatcher::Dispatch([] { fired = fired + 1; });
+        Dispatcher::Loop();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    teardown();
+    return ns / iterations;
+}
+
+template <typename Dispatcher>
+static double MeasureDispatcher(size_t pending, size_t iterations)
+{
+    std::vector<TaskHandle> handles(pending);
+    return MeasureNs<Dispatcher>(
+        pending, iterations,
+        [&](size_t i) { handles[i] = Dispatcher::Dispatch([] { fired = fired + 1; }, 3600000L + static_cast<long>(i)); },
+        [&] {
+            for (TaskHandle handle : handles)
+                Dispatcher::Cancel(handle);
+            Dispatcher::Loop();
+        });
+}
+
+static double MeasureLinearScan(size_t pending, size_t iterations)
+{
+    return MeasureNs<LinearScanDispatcher>(
+        pending, iterations,
+        [](size_t i) { LinearScanDispatcher::Dispatch([] { fired = fired + 1; }, 3600000L + static_cast<long>(i)); },
+        [] { LinearScanDispatcher::Clear(); });
+}
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    std::printf("%10s %16s %16s %16s\n", "pending", "linear scan", "min-heap", "timing wheel");
+    for (size_t pending : {0, 10, 100, 1000, 10000})
+    {
+        // The linear scan copies every pending task per call, so it gets fewer iterations
+        size_t linearIterations = std::max<size_t>(iterations / (1 + pending / 100), 100);
+        double linear = MeasureLinearScan(pending, linearIterations);
+        double heap = MeasureDispatcher<BasicMainThreadDispatcher<0, 24, false>>(pending, iterations);
+        double wheel = MeasureDispatcher<BasicMainThreadDispatcher<0, 24, true>>(pending, iterations);
+        std::printf("%10zu %13.0f ns %13.0f ns %13.0f ns\n", pending, linear, heap, wheel);
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+// Drives DiscordRateLimiter, the part of the DiscordESP send path that decides whether a request
+// goes out, against a simulated Discord that enforces per-bucket limits for each channel and
+// answers with the real X-RateLimit-* headers. The virtual clock starts just before millis()
+// wraps, so the windows straddle the wrap.
+
+#include <Arduino.h>
+#include <cinttypes>
+#include <cstdio>
+#include <map>
+#include <string>
+#include "DiscordRateLimiter.hpp"
+#include "HostCheck.hpp"
+
+static constexpr unsigned long LatencyMs = 30;
+
+// Fixed windows of Limit requests per bucket, like Discord's per-channel message limit
+class SimulatedDiscord
+{
+public:
+    static constexpr int Limit = 5;
+    static constexpr unsigned long WindowMs = 5000;
+
+    struct Response
+    {
+        int status;
+        std::string bucket, remaining, resetAfter, retryAfter, global, scope;
+    };
+
+    // Limits apply per bucket and channel, like Discord's per-route buckets and major parameters
+    Response Handle(const std::string &url, const std::string &bucketName)
+    {
+        uint64_t now = VirtualClock::Now() / 1000;
+        Response response;
+        if (now < _globalUntil)
+        {
+            response.status = 429;
+            response.retryAfter = _seconds(_globalUntil - now);
+            response.global = "true";
+            response.scope = "global";
+            return response;
+        }
+        size_t channel = url.find("channels/");
+        std::string major = channel == std::string::npos ? "" : url.substr(channel, url.find('/', channel + 9) - channel);
+        Bucket &bucket = _buckets[bucketName + " " + major];
+        if (now >= bucket.windowEnd)
+        {
+            bucket.windowEnd = now + WindowMs;
+            bucket.used = 0;
+        }
+        response.bucket = bucketName;
+        response.resetAfter = _seconds(bucket.windowEnd - now);
+        if (bucket.used == Limit)
+        {
+            rateLimited++;
+            response.status = 429;
+            response.remaining = "0";
+            response.retryAfter = response.resetAfter;
+            response.scope = "user";
+            return response;
+        }
+        bucket.used++;
+        response.status = 200;
+        response.remaining = std::to_string(Limit - bucket.used);
+        return response;
+    }
+
+    void BlockGlobally(unsigned long ms) { _globalUntil = VirtualClock::Now() / 1000 + ms; }
+
+    uint32_t rateLimited = 0;
+
+private:
+    struct Bucket
+    {
+        uint64_t windowEnd = 0;
+        int used = 0;
+    };
+
+    static std::string _seconds(uint64_t ms)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "%.3f", ms / 1000.0);
+        return buffer;
+    }
+
+    std::map<std::string, Bucket> _buckets;
+    uint64_t _globalUntil = 0;
+};
+
+// One request the way DiscordESPClient::_sendRequest makes it. Returns the status, or 0 when
+// the request was held back locally.
+static int Send(DiscordRateLimiter &limiter, SimulatedDiscord &discord, const char *method, const std::string &url, const char *bucket, DiscordRateLimitPolicy policy, uint32_t &waitedMs, unsigned long maxWaitMs = SimulatedDiscord::WindowMs)
+{
+    DiscordRateLimitRoute route = DiscordRateLimiter::GetRoute(method, url.c_str());
+    unsigned long wait = limiter.GetWaitTime(route);
+    if (wait > 0)
+    {
+        if (policy == DiscordRateLimitPolicy::Reject || wait > maxWaitMs)
+            return 0;
+        waitedMs += wait;
+        delay(wait);
+    }
+    limiter.OnRequest(route);
+    SimulatedDiscord::Response response = discord.Handle(url, bucket);
+    delay(LatencyMs);
+    limiter.OnResponse(route, response.status, response.bucket.c_str(), response.remaining.c_str(), response.resetAfter.c_str(), response.retryAfter.c_str(), response.global.c_str(), response.scope.c_str());
+    return response.status;
+}
+
+static const char *const ChannelUrl = "https://discord.com/api/v10/channels/1000/messages";
+static const char *const MessagesBucket = "f3a1c9";
+
+static std::string MessageUrl(const char *channel, int message, const char *rest = "")
+{
+    return "https://discord.com/api/v10/channels/" + std::string(channel) + "/messages/" + std::to_string(message) + rest;
+}
+
+int main()
+{
+    // 30 s before millis() wraps
+    VirtualClock::Install((0x100000000ULL - 30000) * 1000);
+
+    {
+        // Wait policy: a burst of 100 messages is paced by the known buckets and never hits a 429
+        DiscordRateLimiter limiter;
+        SimulatedDiscord discord;
+        uint32_t waitedMs = 0;
+        uint32_t sent = 0;
+        uint64_t start = VirtualClock::Now();
+        for (int i = 0; i < 100; i++)
+            sent += Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Wait, waitedMs) == 200;
+        uint64_t elapsedMs = (VirtualClock::Now() - start) / 1000;
+        std::printf("wait: %" PRIu32 " sent, %" PRIu32 " rate limited by Discord, %" PRIu32 " ms waited, %" PRIu64 " ms total\n", sent, discord.rateLimited, waitedMs, elapsedMs);
+        HOST_CHECK(sent == 100);
+        HOST_CHECK(discord.rateLimited == 0);
+        // 20 windows of 5 messages, the first one starting at once
+        HOST_CHECK(elapsedMs >= 19 * SimulatedDiscord::WindowMs && elapsedMs < 21 * SimulatedDiscord::WindowMs);
+    }
+
+    {
+        // Reject policy: requests into an empty bucket fail locally instead of costing a 429
+        DiscordRateLimiter limiter;
+        SimulatedDiscord discord;
+        uint32_t waitedMs = 0;
+        uint32_t sent = 0;
+        uint32_t held = 0;
+        for (int i = 0; i < 200; i++)
+        {
+            int status = Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Reject, waitedMs);
+            sent += status == 200;
+            held += status == 0;
+            delay(100);
+        }
+        std::printf("reject: %" PRIu32 " sent, %" PRIu32 " held back, %" PRIu32 " rate limited by Discord\n", sent, held, discord.rateLimited);
+        HOST_CHECK(discord.rateLimited == 0);
+        HOST_CHECK(sent + held == 200);
+        DiscordRateLimitBudget budget = limiter.GetBudget(DiscordRateLimiter::GetRoute("POST", ChannelUrl));
+        HOST_CHECK(budget.remaining >= 0 && budget.remaining < SimulatedDiscord::Limit);
+    }
+
+    {
+        // A global 429 holds back every route until Retry-After
+        DiscordRateLimiter limiter;
+        SimulatedDiscord discord;
+        uint32_t waitedMs = 0;
+        discord.BlockGlobally(1500);
+        HOST_CHECK(Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Reject, waitedMs) == 429);
+        const char *otherUrl = "https://discord.com/api/v10/channels/2000/messages";
+        HOST_CHECK(Send(limiter, discord, "POST", otherUrl, MessagesBucket, DiscordRateLimitPolicy::Reject, waitedMs) == 0);
+        HOST_CHECK(Send(limiter, discord, "POST", otherUrl, MessagesBucket, DiscordRateLimitPolicy::Wait, waitedMs) == 200);
+        HOST_CHECK(waitedMs > 0 && waitedMs <= 1500);
+    }
+
+    {
+        // Routes are templated: every message id and emoji of a channel is one route
+        DiscordRateLimitRoute reaction = DiscordRateLimiter::GetRoute("PUT", MessageUrl("1000", 1, "/reactions/%F0%9F%91%8D/@me").c_str());
+        HOST_CHECK(reaction.key == DiscordRateLimiter::GetRoute("PUT", MessageUrl("1000", 2, "/reactions/smile:123/@me?x=1").c_str()).key);
+        HOST_CHECK(reaction.key != DiscordRateLimiter::GetRoute("PUT", MessageUrl("2000", 1, "/reactions/%F0%9F%91%8D/@me").c_str()).key);
+        HOST_CHECK(reaction.key != DiscordRateLimiter::GetRoute("DELETE", MessageUrl("1000", 1, "/reactions/%F0%9F%91%8D/@me").c_str()).key);
+        HOST_CHECK(reaction.majorParameter == DiscordRateLimiter::GetRoute("POST", ChannelUrl).majorParameter);
+        // A webhook's token is part of its major parameter
+        DiscordRateLimitRoute webhook = DiscordRateLimiter::GetRoute("POST", "https://discord.com/api/webhooks/42/abc?wait=true");
+        HOST_CHECK(webhook.majorParameter != 0);
+        HOST_CHECK(webhook.majorParameter != DiscordRateLimiter::GetRoute("POST", "https://discord.com/api/webhooks/42/def").majorParameter);
+        HOST_CHECK(DiscordRateLimiter::GetRoute("GET", "https://discord.com/api/v10/users/@me").majorParameter == 0);
+
+        // So reacting to 60 different messages is paced like one route
+        DiscordRateLimiter limiter;
+        SimulatedDiscord discord;
+        uint32_t waitedMs = 0;
+        uint32_t sent = 0;
+        for (int i = 0; i < 60; i++)
+            sent += Send(limiter, discord, "PUT", MessageUrl("1000", 500 + i, "/reactions/%F0%9F%91%8D/@me"), "9b2e70", DiscordRateLimitPolicy::Wait, waitedMs) == 200;
+        std::printf("reactions: %" PRIu32 " sent, %" PRIu32 " rate limited by Discord\n", sent, discord.rateLimited);
+        HOST_CHECK(sent == 60);
+        HOST_CHECK(discord.rateLimited == 0);
+    }
+
+    {
+        // Routes that Discord puts in the same bucket share its budget once the bucket is known:
+        // editing messages alternates with sending them, both drawing on one limit
+        DiscordRateLimiter limiter;
+        SimulatedDiscord discord;
+        uint32_t waitedMs = 0;
+        uint32_t sent = 0;
+        for (int i = 0; i < 40; i++)
+        {
+            if (i % 2 == 0)
+                sent += Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Wait, waitedMs) == 200;
+            else
+                sent += Send(limiter, discord, "PATCH", MessageUrl("1000", i), MessagesBucket, DiscordRateLimitPolicy::Wait, waitedMs) == 200;
+        }
+        std::printf("shared bucket: %" PRIu32 " sent, %" PRIu32 " rate limited by Discord\n", sent, discord.rateLimited);
+        HOST_CHECK(sent == 40);
+        // Only the first request of each route finds out which bucket it is in
+        HOST_CHECK(discord.rateLimited <= 1);
+        DiscordRateLimitBudget post = limiter.GetBudget(DiscordRateLimiter::GetRoute("POST", ChannelUrl));
+        DiscordRateLimitBudget patch = limiter.GetBudget(DiscordRateLimiter::GetRoute("PATCH", MessageUrl("1000", 7).c_str()));
+        HOST_CHECK(post.remaining == patch.remaining && post.resetInMs == patch.resetInMs);
+
+        // The same bucket in another channel has a budget of its own
+        const char *otherUrl = "https://discord.com/api/v10/channels/2000/messages";
+        HOST_CHECK(Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Wait, waitedMs) == 200);
+        while (limiter.GetBudget(DiscordRateLimiter::GetRoute("POST", ChannelUrl)).remaining != 0)
+            Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Wait, waitedMs);
+        HOST_CHECK(Send(limiter, discord, "POST", otherUrl, MessagesBucket, DiscordRateLimitPolicy::Reject, waitedMs) == 200);
+        HOST_CHECK(Send(limiter, discord, "POST", ChannelUrl, MessagesBucket, DiscordRateLimitPolicy::Reject, waitedMs) == 0);
+    }
+    return HostCheckResult();
+}
@@ -0,0 +1,172 @@
+// Feeds ResponseBodyStream from a simulated connection whose bytes arrive over time, as they do
+// from a TLS socket: the parser must not read into the next response, and Finish() must wait
+// for a terminating chunk that arrives after the JSON instead of leaving it on the connection.
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "HostCheck.hpp"
+#include "ResponseBodyStream.hpp"
+
+// Bytes that become readable at given virtual times. Each poll of an empty socket takes 1 ms.
+class SimulatedConnection : public Stream
+{
+public:
+    SimulatedConnection() { setTimeout(1000); }
+
+    void Arrive(unsigned long atMs, const std::string &bytes) { _segments.push_back({atMs, bytes}); }
+
+    int available() override
+    {
+        int count = 0;
+        for (const Segment &segment : _segments)
+        {
+            if (segment.atMs <= millis())
+                count += static_cast<int>(segment.bytes.size());
+        }
+        return count - static_cast<int>(_offset);
+    }
+
+    int peek() override
+    {
+        if (_segments.empty() || _segments.front().atMs > millis())
+        {
+            VirtualClock::Advance(1000);
+            return -1;
+        }
+        return static_cast<uint8_t>(_segments.front().bytes[_offset]);
+    }
+
+    int read() override
+    {
+        int c = peek();
+        if (c >= 0 && ++_offset == _segments.front().bytes.size())
+        {
+            _segments.erase(_segments.begin());
+            _offset = 0;
+        }
+        return c;
+    }
+
+    size_t write(uint8_t) override { return 0; }
+
+    // What is left on the connection, including bytes not arrived yet
+    std::string Rest()
+    {
+        std::string rest;
+        for (const Segment &segment : _segments)
+            rest += segment.bytes;
+        return rest.substr(_offset);
+    }
+
+private:
+    struct Segment
+    {
+        unsigned long atMs;
+        std::string bytes;
+    };
+
+    std::vector<Segment> _segments;
+    size_t _offset = 0;
+};
+
+static std::string ReadAll(Stream &stream)
+{
+    std::string body;
+    for (int c = stream.read(); c >= 0; c = stream.read())
+        body += static_cast<char>(c);
+    return body;
+}
+
+// Reads only the JSON object, the way the parser stops at its closing brace
+static std::string ReadJsonObject(Stream &stream)
+{
+    std::string json;
+    int depth = 0;
+    char c;
+    while (stream.readBytes(&c, 1) == 1)
+    {
+        json += c;
+        depth += c == '{' ? 1 : c == '}' ? -1 : 0;
+        if (depth == 0)
+            break;
+    }
+    return json;
+}
+
+static const char NextResponse[] = "HTTP/1.1 200 OK\r\n";
+
+int main()
+{
+    VirtualClock::Install(1000000);
+    unsigned long now = millis();
+
+    {
+        // Chunks with extensions and a trailer decode to the body
+        SimulatedConnection connection;
+        connection.Arrive(now, "6;ext=1\r\n{\"id\":\r\n4\r\n\"42\"\r\nA\r\n,\"ok\":true\r\n1\r\n}\r\n0\r\nX-Trailer: 1\r\n\r\n");
+        connection.Arrive(now, NextResponse);
+        ResponseBodyStream body(connection, true, -1);
+        HOST_CHECK(ReadAll(body) == "{\"id\":\"42\",\"ok\":true}");
+        HOST_CHECK(body.Finish());
+        HOST_CHECK(connection.Rest() == NextResponse);
+    }
+
+    {
+        // The terminating chunk arrives 50 ms after the JSON: Finish() waits for it
+        now = millis();
+        SimulatedConnection connection;
+        connection.Arrive(now, "d\r\n{\"id\":\"42\"}\n\r\n");
+        connection.Arrive(now + 50, "0\r\n\r\n");
+        connection.Arrive(now + 60, NextResponse);
+        ResponseBodyStream body(connection, true, -1);
+        HOST_CHECK(ReadJsonObject(body) == "{\"id\":\"42\"}");
+        HOST_CHECK(body.Finish());
+        HOST_CHECK(connection.Rest() == NextResponse);
+        HOST_CHECK(millis() - now >= 50 && millis() - now < 1000);
+    }
+
+    {
+        // The terminating chunk never arrives: the connection must not be reused
+        now = millis();
+        SimulatedConnection connection;
+        connection.Arrive(now, "d\r\n{\"id\":\"42\"}\n\r\n");
+        ResponseBodyStream body(connection, true, -1);
+        HOST_CHECK(ReadJsonObject(body) == "{\"id\":\"42\"}");
+        HOST_CHECK(!body.Finish());
+    }
+
+    {
+        // A malformed chunk size line fails instead of being read as body
+        now = millis();
+        SimulatedConnection connection;
+        connection.Arrive(now, "zz\r\n{}\r\n0\r\n\r\n");
+        ResponseBodyStream body(connection, true, -1);
+        HOST_CHECK(ReadAll(body).empty());
+        HOST_CHECK(!body.Finish());
+    }
+
+    {
+        // Content-Length: a trailing newline arriving late is consumed, the next response is not
+        now = millis();
+        SimulatedConnection connection;
+        connection.Arrive(now, "{\"id\":\"42\"}");
+        connection.Arrive(now + 30, "\n");
+        connection.Arrive(now + 30, NextResponse);
+        ResponseBodyStream body(connection, false, 12);
+        HOST_CHECK(ReadJsonObject(body) == "{\"id\":\"42\"}");
+        HOST_CHECK(body.Finish());
+        HOST_CHECK(connection.Rest() == NextResponse);
+    }
+
+    {
+        // No length and not chunked: the body ends with the connection, which is never reusable
+        now = millis();
+        SimulatedConnection connection;
+        connection.Arrive(now, "{}");
+        ResponseBodyStream body(connection, false, -1);
+        HOST_CHECK(ReadAll(body) == "{}");
+        HOST_CHECK(!body.Finish());
+    }
+    return HostCheckResult();
+}
@@ -0,0 +1,103 @@
+// Compares the min-heap and timing wheel backends at large timer counts, the way a gateway tracks
+// per-peer timeouts: N timers with delays up to 10 minutes are inserted, half of them cancelled,
+// and the rest expired by stepping VirtualClock in 10 ms ticks. Reports the cost per operation;
+// the expire cost includes the ticks on which nothing fires. Task slots are indexed with 16 bits,
+// so 65000 is close to the most a dispatcher can hold. A second case times the wake-ups of a
+// sparse schedule, timers hours apart with the clock jumping 3 hours per Loop() as after a deep
+// sleep: the wheel has to catch up on the whole gap each time.
+
+#include <Arduino.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "MainThreadDispatcher.hpp"
+
+using BenchClock = std::chrono::steady_clock;
+
+static double NsSince(BenchClock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+template <typename Dispatcher>
+struct Backend
+{
+    static inline uint32_t fired = 0;
+
+    static void Run(const char *name, size_t timers)
+    {
+        std::vector<TaskHandle> handles(timers);
+        uint32_t random = 1;
+        auto next = [&random] {
+            random = random * 1664525u + 1013904223u;
+            return random >> 8;
+        };
+        fired = 0;
+
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < timers; i++)
+            handles[i] = Dispatcher::Dispatch([] { fired++; }, 1 + next() % 600000);
+        double insertNs = NsSince(start) / timers;
+
+        start = BenchClock::now();
+        size_t cancelled = 0;
+        for (size_t i = 0; i < timers; i += 2)
+            cancelled += Dispatcher::Cancel(handles[i]);
+        double cancelNs = NsSince(start) / cancelled;
+
+        start = BenchClock::now();
+        size_t loops = 0;
+        while (Dispatcher::GetPendingCount() > 0)
+        {
+            VirtualClock::Advance(10000);
+            Dispatcher::Loop();
+            loops++;
+        }
+        double expireNs = NsSince(start) / fired;
+
+        std::printf("%-14s %9zu timers %9.0f ns/insert %9.0f ns/cancel %9.0f ns/expire (%zu ticks)\n", name, timers, insertNs, cancelNs, expireNs, loops);
+        if (cancelled + fired != timers)
+            std::printf("  %zu cancelled + %u fired != %zu\n", cancelled, fired, timers);
+    }
+
+    static void RunGaps(const char *name, size_t timers)
+    {
+        uint32_t random = 1;
+        fired = 0;
+        long delayMs = 0;
+        for (size_t i = 0; i < timers; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+            // 1 to 6 hours apart, past the wheel range at times
+            delayMs += 3600000L + (random >> 8) % 18000000L;
+            Dispatcher::Dispatch([] { fired++; }, delayMs);
+        }
+
+        auto start = BenchClock::now();
+        size_t wakes = 0;
+        while (Dispatcher::GetPendingCount() > 0)
+        {
+            VirtualClock::Advance(3ULL * 3600000000ULL);
+            Dispatcher::Loop();
+            wakes++;
+        }
+        double wakeNs = NsSince(start) / wakes;
+
+        std::printf("%-14s %9zu timers %9.0f ns/wake, %zu wakes over %.0f hours\n", name, timers, wakeNs, wakes, delayMs / 3600000.0);
+        if (fired != timers)
+            std::printf("  %u fired != %zu\n", fired, timers);
+    }
+};
+
+int main()
+{
+    VirtualClock::Install(1000000);
+    for (size_t timers : {10000, 20000, 40000, 65000})
+    {
+        Backend<BasicMainThreadDispatcher<0, 24, false>>::Run("min-heap", timers);
+        Backend<BasicMainThreadDispatcher<0, 24, true>>::Run("timing wheel", timers);
+    }
+    Backend<BasicMainThreadDispatcher<0, 24, false>>::RunGaps("min-heap", 1000);
+    Backend<BasicMainThreadDispatcher<0, 24, true>>::RunGaps("timing wheel", 1000);
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Sends ZaloBotClient requests through HTTPClientMod and the shim's socket to FakeServer: the
+// form-encoded POSTs, GETs with plain and chunked bodies, long polling for updates without
+// blocking, and how errors reported by the API come back.
+
+#include <Arduino.h>
+#include <vector>
+#include "FakeServer.hpp"
+#include "HostCheck.hpp"
+#include "ZaloBotClient.hpp"
+
+static const char Token[] = "1234:secret";
+
+static void Requests()
+{
+    FakeServer::Reset();
+    ZaloBotClient bot(Token);
+    FakeServer::Reply(FakeServer::JsonResponse(200, "{\"ok\":true,\"result\":{\"message_id\":\"m1\"}}"));
+    ZaloBotESPResponse sent = bot.SendMsg("t1", "hello world & more");
+    HOST_CHECK(sent.errorCode == ZaloBotESPResponseCode::Success);
+    HOST_CHECK(sent.responseData[F("message_id")].as<String>() == "m1");
+
+    FakeServer::Reply(FakeServer::ChunkedJsonResponse(200, "{\"ok\":true,\"result\":{\"id\":\"b1\",\"account_name\":\"bot\"}}"));
+    ZaloBotESPResponse me = bot.GetMe();
+    HOST_CHECK(me.errorCode == ZaloBotESPResponseCode::Success);
+    HOST_CHECK(me.responseData[F("account_name")].as<String>() == "bot");
+
+    const std::vector<FakeRequest> &requests = FakeServer::GetRequests();
+    HOST_CHECK(requests.size() == 2);
+    if (requests.size() == 2)
+    {
+        HOST_CHECK(requests[0].method == "POST" && requests[0].path == "/bot1234:secret/sendMessage");
+        HOST_CHECK(requests[0].GetHeader("Host") == "bot-api.zaloplatforms.com");
+        HOST_CHECK(requests[0].GetHeader("Content-Type") == "application/x-www-form-urlencoded");
+        HOST_CHECK(requests[0].body == "chat_id=t1&text=hello+world+%26+more");
+        HOST_CHECK(requests[1].method == "GET" && requests[1].path == "/bot1234:secret/getMe");
+        HOST_CHECK(requests[1].body.isEmpty());
+    }
+
+    // Errors reported in the body take precedence over the HTTP status
+    FakeServer::Reply(FakeServer::JsonResponse(429, "{\"ok\":false,\"error_code\":429,\"description\":\"Too many requests\"}"));
+    ZaloBotESPResponse limited = bot.SendSticker("t1", "s1");
+    HOST_CHECK(limited.errorCode == ZaloBotESPResponseCode::RateLimitExceeded);
+    HOST_CHECK(strcmp(limited.GetLastError(), "Too many requests") == 0);
+    FakeServer::Reply(FakeServer::JsonResponse(200, "{\"ok\":false,\"error_code\":404,\"description\":\"Not found\"}"));
+    HOST_CHECK(bot.SendChatAction("t1", "typing").errorCode == ZaloBotESPResponseCode::NotFound);
+    // The server closes the connection after this one
+    FakeServer::Reply(FakeServer::JsonResponse(200, "{\"ok\":"), 0, true);
+    HOST_CHECK(bot.GetMe().errorCode == ZaloBotESPResponseCode::JsonDeserializationFailed);
+
+    // Nothing goes out without Wi-Fi or with a missing parameter
+    size_t sentCount = FakeServer::GetRequests().size();
+    WiFi.SetStatus(WL_DISCONNECTED);
+    HOST_CHECK(bot.SendMsg("t1", "offline").errorCode == ZaloBotESPResponseCode::WifiNotConnected);
+    HOST_CHECK(bot.GetPollingUpdates().errorCode == ZaloBotESPResponseCode::WifiNotConnected);
+    WiFi.SetStatus(WL_CONNECTED);
+    HOST_CHECK(bot.SendMsg("", "no thread").errorCode == ZaloBotESPResponseCode::InvalidParameter);
+    HOST_CHECK(FakeServer::GetRequests().size() == sentCount);
+
+    FakeServer::RefuseConnections(true);
+    HOST_CHECK(bot.GetMe().errorCode == ZaloBotESPResponseCode::HttpConnectionFailed);
+    FakeServer::RefuseConnections(false);
+
+    // No answer: the request times out after the client's 5 s
+    unsigned long start = millis();
+    HOST_CHECK(bot.GetMe().errorCode == ZaloBotESPResponseCode::HttpReadTimeout);
+    HOST_CHECK(millis() - start >= 5000);
+}
+
+static void Polling()
+{
+    FakeServer::Reset();
+    ZaloBotClient bot(Token);
+
+    // The long poll is answered 3 s later; meanwhile each call returns at once
+    FakeServer::Reply(FakeServer::JsonResponse(200, "{\"ok\":true,\"result\":{\"message\":{\"text\":\"hi\"}}}"), 3000);
+    unsigned long start = millis();
+    HOST_CHECK(bot.GetPollingUpdates().errorCode == ZaloBotESPResponseCode::PollingStarted);
+    HOST_CHECK(FakeServer::GetRequests().size() == 1 && FakeServer::GetRequests()[0].path == "/bot1234:secret/getUpdates");
+    int inProgress = 0;
+    ZaloBotESPResponse update(ZaloBotESPResponseCode::UnknownError);
+    for (;;)
+    {
+        unsigned long before = millis();
+        update = bot.GetPollingUpdates();
+        if (update.errorCode != ZaloBotESPResponseCode::PollingInProgress)
+            break;
+        HOST_CHECK(millis() == before);
+        inProgress++;
+        delay(100);
+    }
+    HOST_CHECK(update.errorCode == ZaloBotESPResponseCode::Success);
+    HOST_CHECK(update.responseData[F("message")][F("text")].as<String>() == "hi");
+    HOST_CHECK(inProgress == 30 && millis() - start == 3000);
+
+    // A request while polling cancels the poll, and the next call starts a new one
+    HOST_CHECK(bot.GetPollingUpdates().errorCode == ZaloBotESPResponseCode::PollingStarted);
+    size_t connections = FakeServer::GetConnectCount();
+    FakeServer::Reply(FakeServer::JsonResponse(200, "{\"ok\":true,\"result\":{}}"));
+    HOST_CHECK(bot.SendMsg("t1", "while polling").errorCode == ZaloBotESPResponseCode::Success);
+    HOST_CHECK(FakeServer::GetConnectCount() == connections + 1);
+    HOST_CHECK(FakeServer::GetPendingReplyCount() == 0);
+    FakeServer::Reply(FakeServer::JsonResponse(200, "{\"ok\":true,\"result\":{}}"));
+    HOST_CHECK(bot.GetPollingUpdates().errorCode == ZaloBotESPResponseCode::PollingStarted);
+    delay(1);
+    HOST_CHECK(bot.GetPollingUpdates().errorCode == ZaloBotESPResponseCode::Success);
+    const std::vector<FakeRequest> &requests = FakeServer::GetRequests();
+    HOST_CHECK(requests.size() == 4 && requests[3].path == "/bot1234:secret/getUpdates");
+}
+
+int main()
+{
+    VirtualClock::Install(0);
+    Requests();
+    Polling();
+    return HostCheckResult();
+}
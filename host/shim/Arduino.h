@@ -0,0 +1,146 @@
+#pragma once
+
+// Just enough of the Arduino core to build the libraries on a Linux host. Time goes through
+// MonotonicClock, so once VirtualClock is installed millis() and delay() follow the simulated
+// clock and a day of scheduling runs in a fraction of a second.
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <thread>
+#include "WString.h"
+
+// Raw host clock, wrapping at 32 bits like on the boards. MonotonicClock's default source reads
+// it, so unlike millis() it never follows VirtualClock.
+inline unsigned long micros()
+{
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+#include "VirtualClock.hpp"
+
+// Wraps at 32 bits like on the boards, which simulations can reach by starting the virtual
+// clock just before the wrap
+inline unsigned long millis() { return static_cast<uint32_t>(MonotonicClock::Micros() / 1000); }
+
+inline void delay(unsigned long ms)
+{
+    if (VirtualClock::IsInstalled())
+        VirtualClock::Advance(static_cast<uint64_t>(ms) * 1000);
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void yield() {}
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        while (written < size && write(buffer[written]) == 1)
+            written++;
+        return written;
+    }
+    virtual void flush() {}
+
+    size_t write(const char *text) { return text == nullptr ? 0 : write(reinterpret_cast<const uint8_t *>(text), strlen(text)); }
+    size_t write(const char *buffer, size_t size) { return write(reinterpret_cast<const uint8_t *>(buffer), size); }
+
+    size_t print(const char *text) { return write(text); }
+    size_t print(const __FlashStringHelper *text) { return write(reinterpret_cast<const char *>(text)); }
+    size_t print(const String &text) { return write(text.c_str(), text.length()); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    template <typename Number, typename = std::enable_if_t<std::is_arithmetic<Number>::value>>
+    size_t print(Number value) { return print(String(value)); }
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t written = print(value);
+        return written + println();
+    }
+
+    __attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...)
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return length <= 0 ? 0 : write(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+    }
+
+    int getWriteError() { return _writeError; }
+    void clearWriteError() { _writeError = 0; }
+
+protected:
+    void setWriteError(int error = 1) { _writeError = error; }
+
+private:
+    int _writeError = 0;
+};
+
+// Reads wait up to the timeout for data, polling read() like the Arduino core does
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeoutMs) { _timeout = timeoutMs; }
+
+    virtual size_t readBytes(char *buffer, size_t length)
+    {
+        size_t count = 0;
+        for (; count < length; count++)
+        {
+            int c = timedRead();
+            if (c < 0)
+                break;
+            buffer[count] = static_cast<char>(c);
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes(reinterpret_cast<char *>(buffer), length); }
+
+    String readStringUntil(char terminator)
+    {
+        String text;
+        for (int c = timedRead(); c >= 0 && c != terminator; c = timedRead())
+            text += static_cast<char>(c);
+        return text;
+    }
+
+    String readString()
+    {
+        String text;
+        for (int c = timedRead(); c >= 0; c = timedRead())
+            text += static_cast<char>(c);
+        return text;
+    }
+
+protected:
+    int timedRead()
+    {
+        unsigned long start = millis();
+        do
+        {
+            int c = read();
+            if (c >= 0)
+                return c;
+            yield();
+        } while (millis() - start < _timeout);
+        return -1;
+    }
+
+    unsigned long _timeout = 1000;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Serial writes to stdout and never has input
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void end() {}
+    size_t write(uint8_t c) override { return std::fputc(c, stdout) == EOF ? 0 : 1; }
+    size_t write(const uint8_t *buffer, size_t size) override { return std::fwrite(buffer, 1, size, stdout); }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override { std::fflush(stdout); }
+    operator bool() const { return true; }
+
+    using Print::write;
+};
+
+inline HardwareSerial Serial;
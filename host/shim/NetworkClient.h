@@ -0,0 +1,81 @@
+#pragma once
+
+// A client socket connected to FakeServer instead of the network. Reading with nothing to read
+// takes a millisecond, so blocking reads time out on the virtual clock.
+
+#include <Arduino.h>
+#include "Client.h"
+#include "FakeServer.hpp"
+
+class NetworkClient : public Client
+{
+public:
+    int connect(const char *host, uint16_t port) override
+    {
+        stop();
+        _connection = FakeServer::Connect(host, port);
+        return _connection ? 1 : 0;
+    }
+    int connect(const char *host, uint16_t port, int32_t) { return connect(host, port); }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        if (!_connection || _connection->closed || _connection->reset)
+        {
+            _connection.reset();
+            setWriteError();
+            return 0;
+        }
+        FakeServer::Receive(*_connection, buffer, size);
+        return size;
+    }
+
+    int available() override
+    {
+        if (!_connection || MonotonicClock::Micros() < _connection->readableAtUs)
+            return 0;
+        return static_cast<int>(_connection->pending.size());
+    }
+    int read() override
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int read(uint8_t *buffer, size_t size) override
+    {
+        size_t count = std::min<size_t>(available(), size);
+        if (count == 0)
+        {
+            delay(1);
+            return -1;
+        }
+        memcpy(buffer, _connection->pending.data(), count);
+        _connection->pending.erase(0, count);
+        return static_cast<int>(count);
+    }
+    int peek() override { return available() > 0 ? static_cast<uint8_t>(_connection->pending[0]) : -1; }
+    void flush() override {}
+    void clear()
+    {
+        if (_connection)
+            _connection->pending.clear();
+    }
+
+    void stop() override
+    {
+        if (_connection)
+            _connection->closed = true;
+        _connection.reset();
+    }
+    uint8_t connected() override { return _connection && (!_connection->closed || !_connection->pending.empty()); }
+    operator bool() override { return connected(); }
+
+    void setNoDelay(bool) {}
+
+    using Client::readBytes;
+    using Print::write;
+
+private:
+    std::shared_ptr<FakeServer::Connection> _connection;
+};
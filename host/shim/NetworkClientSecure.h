@@ -0,0 +1,13 @@
+#pragma once
+
+// TLS settings are accepted and ignored: the fake socket carries plain HTTP
+#include "NetworkClient.h"
+
+class NetworkClientSecure : public NetworkClient
+{
+public:
+    void setCACert(const char *) {}
+    void setCertificate(const char *) {}
+    void setPrivateKey(const char *) {}
+    void setInsecure() {}
+};
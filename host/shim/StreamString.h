@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+
+// A String that can be written to as a Print and read back from the front as a Stream
+class StreamString : public Stream, public String
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        concat(static_cast<char>(c));
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        concat(reinterpret_cast<const char *>(buffer), size);
+        return size;
+    }
+    int available() override { return length(); }
+    int read() override
+    {
+        if (length() == 0)
+            return -1;
+        uint8_t c = static_cast<uint8_t>(charAt(0));
+        remove(0, 1);
+        return c;
+    }
+    int peek() override { return length() == 0 ? -1 : static_cast<uint8_t>(charAt(0)); }
+
+    using Print::write;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+// The part of the Arduino String class and the PROGMEM helpers the libraries use, over
+// std::string. Flash strings are plain strings on the host, as on ESP32.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+#include <type_traits>
+#include <utility>
+
+class __FlashStringHelper;
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(PSTR(s))
+#define pgm_read_byte(p) (*reinterpret_cast<const uint8_t *>(p))
+#define pgm_read_word(p) (*reinterpret_cast<const uint16_t *>(p))
+#define pgm_read_dword(p) (*reinterpret_cast<const uint32_t *>(p))
+#define pgm_read_float(p) (*reinterpret_cast<const float *>(p))
+#define pgm_read_double(p) (*reinterpret_cast<const double *>(p))
+#define pgm_read_ptr(p) (*reinterpret_cast<const void *const *>(p))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+#define vsnprintf_P vsnprintf
+
+class String
+{
+public:
+    String() = default;
+    String(const char *text) : _text(text == nullptr ? "" : text) {}
+    String(const __FlashStringHelper *text) : String(reinterpret_cast<const char *>(text)) {}
+    String(const std::string &text) : _text(text) {}
+    explicit String(char c) : _text(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : String(static_cast<unsigned long long>(value), base) {}
+    explicit String(int value, unsigned char base = 10) : String(static_cast<long long>(value), base) {}
+    explicit String(unsigned int value, unsigned char base = 10) : String(static_cast<unsigned long long>(value), base) {}
+    explicit String(long value, unsigned char base = 10) : String(static_cast<long long>(value), base) {}
+    explicit String(unsigned long value, unsigned char base = 10) : String(static_cast<unsigned long long>(value), base) {}
+    explicit String(long long value, unsigned char base = 10)
+    {
+        if (value < 0)
+        {
+            _text = "-";
+            _text += _digits(-static_cast<unsigned long long>(value), base);
+        }
+        else
+            _text = _digits(static_cast<unsigned long long>(value), base);
+    }
+    explicit String(unsigned long long value, unsigned char base = 10) : _text(_digits(value, base)) {}
+    explicit String(float value, unsigned int decimals = 2) : String(static_cast<double>(value), decimals) {}
+    explicit String(double value, unsigned int decimals = 2)
+    {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%.*f", static_cast<int>(decimals), value);
+        _text = buffer;
+    }
+
+    unsigned int length() const { return static_cast<unsigned int>(_text.size()); }
+    bool isEmpty() const { return _text.empty(); }
+    const char *c_str() const { return _text.c_str(); }
+    bool reserve(unsigned int size)
+    {
+        _text.reserve(size);
+        return true;
+    }
+    void clear() { _text.clear(); }
+    // A String that could allocate its buffer, which on the host is every String
+    explicit operator bool() const { return true; }
+
+    bool concat(const String &text)
+    {
+        _text += text._text;
+        return true;
+    }
+    bool concat(const char *text)
+    {
+        if (text == nullptr)
+            return false;
+        _text += text;
+        return true;
+    }
+    bool concat(const char *text, unsigned int length)
+    {
+        if (text == nullptr)
+            return false;
+        _text.append(text, length);
+        return true;
+    }
+    bool concat(const __FlashStringHelper *text) { return concat(reinterpret_cast<const char *>(text)); }
+    bool concat(char c)
+    {
+        _text += c;
+        return true;
+    }
+    template <typename Number, typename = std::enable_if_t<std::is_arithmetic<Number>::value && !std::is_same<Number, char>::value>>
+    bool concat(Number value) { return concat(String(value)); }
+
+    template <typename T>
+    String &operator+=(const T &value)
+    {
+        concat(value);
+        return *this;
+    }
+
+    template <typename T>
+    friend String operator+(String left, const T &right)
+    {
+        left.concat(right);
+        return left;
+    }
+    friend String operator+(const char *left, const String &right) { return String(left) + right; }
+
+    bool equals(const String &other) const { return _text == other._text; }
+    bool equals(const char *other) const { return _text == (other == nullptr ? "" : other); }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+    bool operator==(const String &other) const { return equals(other); }
+    bool operator==(const char *other) const { return equals(other); }
+    bool operator!=(const String &other) const { return !equals(other); }
+    bool operator!=(const char *other) const { return !equals(other); }
+    bool operator<(const String &other) const { return _text < other._text; }
+    int compareTo(const String &other) const { return _text.compare(other._text); }
+
+    bool startsWith(const String &prefix) const { return startsWith(prefix, 0); }
+    bool startsWith(const String &prefix, unsigned int offset) const { return offset <= _text.size() && _text.compare(offset, prefix._text.size(), prefix._text) == 0; }
+    bool endsWith(const String &suffix) const { return _text.size() >= suffix._text.size() && _text.compare(_text.size() - suffix._text.size(), suffix._text.size(), suffix._text) == 0; }
+
+    char charAt(unsigned int index) const { return index < _text.size() ? _text[index] : '\0'; }
+    void setCharAt(unsigned int index, char c)
+    {
+        if (index < _text.size())
+            _text[index] = c;
+    }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char &operator[](unsigned int index) { return _text[index]; }
+
+    int indexOf(char c, unsigned int from = 0) const { return _position(_text.find(c, from)); }
+    int indexOf(const String &text, unsigned int from = 0) const { return _position(_text.find(text._text, from)); }
+    int lastIndexOf(char c) const { return _position(_text.rfind(c)); }
+    int lastIndexOf(char c, unsigned int from) const { return _position(_text.rfind(c, from)); }
+    int lastIndexOf(const String &text) const { return _position(_text.rfind(text._text)); }
+    int lastIndexOf(const String &text, unsigned int from) const { return _position(_text.rfind(text._text, from)); }
+
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= _text.size())
+            return String();
+        return String(_text.substr(from, std::min<size_t>(to, _text.size()) - from));
+    }
+
+    void replace(char find, char with)
+    {
+        for (char &c : _text)
+        {
+            if (c == find)
+                c = with;
+        }
+    }
+    void replace(const String &find, const String &with)
+    {
+        if (find._text.empty())
+            return;
+        for (size_t at = _text.find(find._text); at != std::string::npos; at = _text.find(find._text, at + with._text.size()))
+            _text.replace(at, find._text.size(), with._text);
+    }
+    void remove(unsigned int index) { remove(index, length()); }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < _text.size())
+            _text.erase(index, count);
+    }
+    void toLowerCase()
+    {
+        for (char &c : _text)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    void toUpperCase()
+    {
+        for (char &c : _text)
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    void trim()
+    {
+        size_t end = _text.find_last_not_of(" \t\r\n\f\v");
+        if (end == std::string::npos)
+        {
+            _text.clear();
+            return;
+        }
+        _text.erase(end + 1);
+        _text.erase(0, _text.find_first_not_of(" \t\r\n\f\v"));
+    }
+
+    long toInt() const { return std::strtol(c_str(), nullptr, 10); }
+    float toFloat() const { return std::strtof(c_str(), nullptr); }
+    double toDouble() const { return std::strtod(c_str(), nullptr); }
+
+    void getBytes(unsigned char *buffer, unsigned int size, unsigned int index = 0) const { toCharArray(reinterpret_cast<char *>(buffer), size, index); }
+    void toCharArray(char *buffer, unsigned int size, unsigned int index = 0) const
+    {
+        if (size == 0)
+            return;
+        size_t count = index < _text.size() ? std::min<size_t>(size - 1, _text.size() - index) : 0;
+        std::memcpy(buffer, _text.data() + std::min<size_t>(index, _text.size()), count);
+        buffer[count] = '\0';
+    }
+
+    const char *begin() const { return _text.data(); }
+    const char *end() const { return _text.data() + _text.size(); }
+
+private:
+    static std::string _digits(unsigned long long value, unsigned char base)
+    {
+        if (base < 2 || base > 36)
+            base = 10;
+        std::string digits;
+        do
+        {
+            digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[value % base]);
+            value /= base;
+        } while (value != 0);
+        return digits;
+    }
+
+    static int _position(size_t at) { return at == std::string::npos ? -1 : static_cast<int>(at); }
+
+    std::string _text;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include "NetworkClient.h"
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+using WiFiClient = NetworkClient;
+
+// Always connected unless a test says otherwise with SetStatus()
+class WiFiClass
+{
+public:
+    wl_status_t status() const { return _status; }
+
+    void SetStatus(wl_status_t status) { _status = status; }
+
+private:
+    wl_status_t _status = WL_CONNECTED;
+};
+
+inline WiFiClass WiFi;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "NetworkClientSecure.h"
+
+using WiFiClientSecure = NetworkClientSecure;
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+class base64
+{
+public:
+    static String encode(const uint8_t *data, size_t length)
+    {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        String encoded;
+        encoded.reserve((length + 2) / 3 * 4);
+        for (size_t i = 0; i < length; i += 3)
+        {
+            uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+            if (i + 1 < length)
+                group |= static_cast<uint32_t>(data[i + 1]) << 8;
+            if (i + 2 < length)
+                group |= data[i + 2];
+            encoded += alphabet[(group >> 18) & 0x3F];
+            encoded += alphabet[(group >> 12) & 0x3F];
+            encoded += i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+            encoded += i + 2 < length ? alphabet[group & 0x3F] : '=';
+        }
+        return encoded;
+    }
+    static String encode(const String &text) { return encode(reinterpret_cast<const uint8_t *>(text.c_str()), text.length()); }
+};
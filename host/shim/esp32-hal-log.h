@@ -0,0 +1,8 @@
+#pragma once
+
+// The core's log levels all compile to nothing on the host
+#define log_e(...) do { } while (0)
+#define log_w(...) do { } while (0)
+#define log_i(...) do { } while (0)
+#define log_d(...) do { } while (0)
+#define log_v(...) do { } while (0)
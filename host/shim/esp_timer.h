@@ -0,0 +1,11 @@
+#pragma once
+
+// For the library sources built with ESP32 defined: the core's boot-relative microsecond clock
+#include <chrono>
+#include <cstdint>
+
+inline int64_t esp_timer_get_time()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}